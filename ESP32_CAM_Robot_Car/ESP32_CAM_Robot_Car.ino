@@ -10,6 +10,7 @@
 #include <WiFi.h>
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#include "alloc_trace.h"
 
 // Setup Access Point Credentials
 const char* ssid1 = "MEO-F51500";
@@ -42,6 +43,7 @@ extern volatile unsigned long move_interval;
 #define PCLK_GPIO_NUM     22
 
 void startCameraServer();
+void startVision();
 
 void setup() 
 {
@@ -86,7 +88,9 @@ void setup()
   }
 
   // camera init
+  alloc_trace_begin();
   esp_err_t err = esp_camera_init(&config);
+  alloc_trace_end(ALLOC_CAMERA);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x", err);
     return;
@@ -99,12 +103,21 @@ void setup()
   s->set_hmirror(s, 1);
 
   
+  // WiFi.begin returns before association, most of the stack's buffers come after it
+  alloc_trace_begin();
   WiFi.begin(ssid1, password1);
+  for (int i = 0; i < 100 && WiFi.status() != WL_CONNECTED; i++) {
+    delay(100);
+  }
+  alloc_trace_end(ALLOC_WIFI);
   IPAddress myIP = WiFi.softAPIP();
   Serial.print("AP IP address: ");
   Serial.println(myIP);
   
+  alloc_trace_begin();
   startCameraServer();
+  alloc_trace_end(ALLOC_HTTPD);
+  startVision();
 
   ledcSetup(7, 5000, 8);
   ledcAttachPin(4, 7);  //pin4 is LED
@@ -120,6 +133,8 @@ void setup()
   digitalWrite(33,LOW);
       
   previous_time = millis();
+  // Heap growth from here on that no tag accounts for is reported as untracked
+  alloc_trace_ready();
 }
 
 void loop() {
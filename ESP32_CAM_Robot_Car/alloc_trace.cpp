@@ -0,0 +1,228 @@
+/*
+  ESP32_CAM_Robot_Car
+  alloc_trace.cpp
+  Heap and PSRAM usage per subsystem, dumped at /heap
+
+*/
+
+#include "alloc_trace.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "soc/soc_memory_layout.h"
+#include "params.h"
+
+typedef struct {
+  const char * name;
+  uint32_t caps;
+} alloc_heap_t;
+
+static const alloc_heap_t alloc_heaps[] = {
+  {"internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT},
+  {"dma",      MALLOC_CAP_DMA},
+  {"psram",    MALLOC_CAP_SPIRAM},
+};
+
+#if ALLOC_TRACE
+
+static const char* alloc_tag_names[ALLOC_TAG_COUNT] = {"camera", "wifi", "httpd", "query", "jpeg", "frame", "vision"};
+
+// What the numbers of each tag cover, see alloc_trace.h
+static const char* alloc_tag_scopes[ALLOC_TAG_COUNT] = {"startup", "startup", "startup", "live", "live", "count", "live"};
+
+enum {
+  ALLOC_INTERNAL,
+  ALLOC_PSRAM,
+  ALLOC_HEAP_COUNT
+};
+
+static const char* alloc_heap_names[ALLOC_HEAP_COUNT] = {"internal", "psram"};
+
+typedef struct {
+  uint32_t allocs;   // allocations made
+  uint32_t failed;   // allocations or captures that failed
+  uint32_t live;     // allocations not freed yet
+  uint32_t bytes[ALLOC_HEAP_COUNT];    // bytes not freed yet, by heap
+  uint32_t peak[ALLOC_HEAP_COUNT];     // highest value of bytes, by heap
+  uint32_t startup[ALLOC_HEAP_COUNT];  // taken between alloc_trace_begin and alloc_trace_end, by heap
+} alloc_stats_t;
+
+// Header in front of every alloc_trace_malloc block, 8 bytes to keep the alignment
+typedef struct {
+  uint32_t size;
+  uint32_t tag;
+} alloc_header_t;
+
+static alloc_stats_t alloc_stats[ALLOC_TAG_COUNT];
+static uint32_t alloc_traced[ALLOC_HEAP_COUNT];  // bytes of all tags together
+static portMUX_TYPE alloc_lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t begin_free[ALLOC_HEAP_COUNT];
+static bool ready = false;
+static size_t ready_free[ALLOC_HEAP_COUNT];
+static uint32_t ready_traced[ALLOC_HEAP_COUNT];
+
+static inline int alloc_heap(const void * ptr) {
+  return esp_ptr_external_ram(ptr) ? ALLOC_PSRAM : ALLOC_INTERNAL;
+}
+
+static void heap_free_sizes(size_t * free_size) {
+  free_size[ALLOC_INTERNAL] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  free_size[ALLOC_PSRAM] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void alloc_trace_add(alloc_tag_t tag, const void * ptr, size_t size) {
+  int heap = alloc_heap(ptr);
+  portENTER_CRITICAL(&alloc_lock);
+  alloc_stats_t * st = &alloc_stats[tag];
+  st->allocs++;
+  st->live++;
+  st->bytes[heap] += size;
+  if (st->bytes[heap] > st->peak[heap]) st->peak[heap] = st->bytes[heap];
+  alloc_traced[heap] += size;
+  portEXIT_CRITICAL(&alloc_lock);
+}
+
+void alloc_trace_remove(alloc_tag_t tag, const void * ptr, size_t size) {
+  int heap = alloc_heap(ptr);
+  portENTER_CRITICAL(&alloc_lock);
+  alloc_stats_t * st = &alloc_stats[tag];
+  st->live--;
+  st->bytes[heap] -= size;
+  alloc_traced[heap] -= size;
+  portEXIT_CRITICAL(&alloc_lock);
+}
+
+void alloc_trace_fail(alloc_tag_t tag) {
+  portENTER_CRITICAL(&alloc_lock);
+  alloc_stats[tag].failed++;
+  portEXIT_CRITICAL(&alloc_lock);
+}
+
+void * alloc_trace_malloc(alloc_tag_t tag, size_t size, uint32_t caps) {
+  alloc_header_t * h = (alloc_header_t *)heap_caps_malloc(sizeof(alloc_header_t) + size, caps);
+  if (!h) {
+    alloc_trace_fail(tag);
+    return NULL;
+  }
+  h->size = size;
+  h->tag = tag;
+  alloc_trace_add(tag, h, size);
+  return h + 1;
+}
+
+void alloc_trace_free(void * ptr) {
+  if (!ptr) {
+    return;
+  }
+  alloc_header_t * h = (alloc_header_t *)ptr - 1;
+  alloc_trace_remove((alloc_tag_t)h->tag, h, h->size);
+  heap_caps_free(h);
+}
+
+void alloc_trace_begin() {
+  heap_free_sizes(begin_free);
+}
+
+void alloc_trace_end(alloc_tag_t tag) {
+  size_t end_free[ALLOC_HEAP_COUNT];
+  heap_free_sizes(end_free);
+  for (int i = 0; i < ALLOC_HEAP_COUNT; i++) {
+    alloc_stats[tag].startup[i] += begin_free[i] > end_free[i] ? begin_free[i] - end_free[i] : 0;
+  }
+}
+
+void alloc_trace_ready() {
+  heap_free_sizes(ready_free);
+  portENTER_CRITICAL(&alloc_lock);
+  memcpy(ready_traced, alloc_traced, sizeof(ready_traced));
+  portEXIT_CRITICAL(&alloc_lock);
+  ready = true;
+}
+
+#endif
+
+static char * append_field(char * p, const char * key, uint32_t val) {
+  *p++ = '"';
+  p = append_str(p, key);
+  *p++ = '"';
+  *p++ = ':';
+  return append_uint(p, val);
+}
+
+char * alloc_trace_json(char * buf) {
+  // The build stamp lets dumps from different firmware builds be told apart
+  char * p = append_str(buf, "{\"build\":\"" __DATE__ " " __TIME__ "\",\"uptime\":");
+  p = append_uint(p, (uint32_t)(esp_timer_get_time() / 1000));
+  p = append_str(p, ",\"heaps\":{");
+  for (size_t i = 0; i < sizeof(alloc_heaps) / sizeof(alloc_heaps[0]); i++) {
+    uint32_t caps = alloc_heaps[i].caps;
+    if (i) *p++ = ',';
+    *p++ = '"';
+    p = append_str(p, alloc_heaps[i].name);
+    p = append_str(p, "\":{");
+    p = append_field(p, "size", heap_caps_get_total_size(caps));
+    *p++ = ',';
+    p = append_field(p, "free", heap_caps_get_free_size(caps));
+    *p++ = ',';
+    p = append_field(p, "min_free", heap_caps_get_minimum_free_size(caps));
+    *p++ = ',';
+    p = append_field(p, "largest", heap_caps_get_largest_free_block(caps));
+    *p++ = '}';
+  }
+  *p++ = '}';
+#if ALLOC_TRACE
+  alloc_stats_t stats[ALLOC_TAG_COUNT];
+  uint32_t traced[ALLOC_HEAP_COUNT];
+  size_t free_now[ALLOC_HEAP_COUNT];
+  heap_free_sizes(free_now);
+  portENTER_CRITICAL(&alloc_lock);
+  memcpy(stats, alloc_stats, sizeof(stats));
+  memcpy(traced, alloc_traced, sizeof(traced));
+  portEXIT_CRITICAL(&alloc_lock);
+
+  p = append_str(p, ",\"tags\":{");
+  for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+    if (i) *p++ = ',';
+    *p++ = '"';
+    p = append_str(p, alloc_tag_names[i]);
+    p = append_str(p, "\":{\"scope\":\"");
+    p = append_str(p, alloc_tag_scopes[i]);
+    p = append_str(p, "\",");
+    p = append_field(p, "allocs", stats[i].allocs);
+    *p++ = ',';
+    p = append_field(p, "failed", stats[i].failed);
+    *p++ = ',';
+    p = append_field(p, "live", stats[i].live);
+    for (int h = 0; h < ALLOC_HEAP_COUNT; h++) {
+      p = append_str(p, ",\"");
+      p = append_str(p, alloc_heap_names[h]);
+      p = append_str(p, "\":{");
+      p = append_field(p, "bytes", stats[i].bytes[h]);
+      *p++ = ',';
+      p = append_field(p, "peak", stats[i].peak[h]);
+      *p++ = ',';
+      p = append_field(p, "startup", stats[i].startup[h]);
+      *p++ = '}';
+    }
+    *p++ = '}';
+  }
+  *p++ = '}';
+
+  // Heap growth since setup that no tag accounts for, negative when the heaps shrank
+  if (ready) {
+    p = append_str(p, ",\"untracked\":{");
+    for (int h = 0; h < ALLOC_HEAP_COUNT; h++) {
+      int32_t used = (int32_t)ready_free[h] - (int32_t)free_now[h];
+      int32_t traced_growth = (int32_t)traced[h] - (int32_t)ready_traced[h];
+      if (h) *p++ = ',';
+      *p++ = '"';
+      p = append_str(p, alloc_heap_names[h]);
+      *p++ = '"';
+      *p++ = ':';
+      p = append_int(p, used - traced_growth);
+    }
+    *p++ = '}';
+  }
+#endif
+  *p++ = '}';
+  return p;
+}
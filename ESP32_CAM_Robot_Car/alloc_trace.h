@@ -0,0 +1,72 @@
+/*
+  ESP32_CAM_Robot_Car
+  alloc_trace.h
+  Heap and PSRAM usage per subsystem, dumped at /heap
+
+  Allocations made through alloc_trace_malloc carry a small header with
+  their tag and size. Buffers allocated inside libraries are accounted
+  with alloc_trace_add / alloc_trace_remove, and what a subsystem takes
+  while it starts up is measured between alloc_trace_begin and
+  alloc_trace_end. Bytes are kept apart by the heap the block is in,
+  internal RAM or PSRAM.
+
+  The camera driver, WiFi and httpd allocate inside the libraries, so only
+  their startup is measured. What the heaps grow by after alloc_trace_ready,
+  less the growth of the traced tags, is reported as untracked: WiFi and
+  lwIP buffers and httpd sessions show up there at runtime.
+  Build with ALLOC_TRACE 0 to compile it all out.
+*/
+
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_heap_caps.h"
+
+#ifndef ALLOC_TRACE
+#define ALLOC_TRACE 1
+#endif
+
+typedef enum {
+  ALLOC_CAMERA,   // camera driver and frame buffers, startup only
+  ALLOC_WIFI,     // WiFi stack, startup only
+  ALLOC_HTTPD,    // httpd servers, startup only
+  ALLOC_QUERY,    // cmd_handler query strings
+  ALLOC_JPEG,     // frame2jpg output buffers, only used when the sensor is not in JPEG mode
+  ALLOC_FRAME,    // camera frame buffers held by the stream, capture and vision, counted only
+                  // since the driver allocated them at startup, under camera
+  ALLOC_VISION,   // odometry and floor classifier state, allocated when first turned on
+  ALLOC_TAG_COUNT
+} alloc_tag_t;
+
+#if ALLOC_TRACE
+
+void * alloc_trace_malloc(alloc_tag_t tag, size_t size, uint32_t caps);
+void alloc_trace_free(void * ptr);
+// ptr is the block, to tell which heap it is in, size may be 0 to only count it
+void alloc_trace_add(alloc_tag_t tag, const void * ptr, size_t size);
+void alloc_trace_remove(alloc_tag_t tag, const void * ptr, size_t size);
+void alloc_trace_fail(alloc_tag_t tag);
+void alloc_trace_begin();
+void alloc_trace_end(alloc_tag_t tag);
+// Marks the end of setup, the untracked growth of the heaps is counted from here
+void alloc_trace_ready();
+// Writes the JSON dump into buf and returns its end, buf needs about 2 KB
+char * alloc_trace_json(char * buf);
+
+#else
+
+static inline void * alloc_trace_malloc(alloc_tag_t tag, size_t size, uint32_t caps) { return heap_caps_malloc(size, caps); }
+static inline void alloc_trace_free(void * ptr) { heap_caps_free(ptr); }
+static inline void alloc_trace_add(alloc_tag_t tag, const void * ptr, size_t size) {}
+static inline void alloc_trace_remove(alloc_tag_t tag, const void * ptr, size_t size) {}
+static inline void alloc_trace_fail(alloc_tag_t tag) {}
+static inline void alloc_trace_begin() {}
+static inline void alloc_trace_end(alloc_tag_t tag) {}
+static inline void alloc_trace_ready() {}
+char * alloc_trace_json(char * buf);
+
+#endif
+
+#endif
@@ -12,6 +12,14 @@
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "Arduino.h"
+#include <WiFi.h>
+#include "lwip/sockets.h"
+#include "params.h"
+#include "robot_params.h"
+#include "alloc_trace.h"
+#include "odometry.h"
+#include "floor.h"
+#include "esp_jpg_decode.h"
 
 #define LEFT_M0     13
 #define LEFT_M1     12
@@ -40,6 +48,9 @@ void robot_left();
 void robot_right();
 uint8_t robo = 0;
 
+// Stream frame rate in tenths of fps, 0 when nobody is streaming
+volatile uint32_t stream_fps_x10 = 0;
+
 
 typedef struct {
   httpd_req_t *req;
@@ -66,12 +77,32 @@ static size_t jpg_encode_stream(void * arg, size_t index, const void* data, size
   return len;
 }
 
+// Frame buffers taken from the camera driver, counted under ALLOC_FRAME while held.
+// Their memory was allocated by esp_camera_init and is accounted under ALLOC_CAMERA.
+static camera_fb_t * frame_get() {
+  camera_fb_t * fb = esp_camera_fb_get();
+  if (fb) {
+    alloc_trace_add(ALLOC_FRAME, fb->buf, 0);
+  } else {
+    alloc_trace_fail(ALLOC_CAMERA);
+  }
+  return fb;
+}
+
+static void frame_return(camera_fb_t * fb) {
+  alloc_trace_remove(ALLOC_FRAME, fb->buf, 0);
+  esp_camera_fb_return(fb);
+}
+
+// frame2jpg allocates a fixed 64 KB output buffer whatever the encoded size
+#define FRAME2JPG_BUF_LEN (64 * 1024)
+
 static esp_err_t capture_handler(httpd_req_t *req) {
   camera_fb_t * fb = NULL;
   esp_err_t res = ESP_OK;
   int64_t fr_start = esp_timer_get_time();
 
-  fb = esp_camera_fb_get();
+  fb = frame_get();
   if (!fb) {
     Serial.println("Camera capture failed");
     httpd_resp_send_500(req);
@@ -95,7 +126,7 @@ static esp_err_t capture_handler(httpd_req_t *req) {
       httpd_resp_send_chunk(req, NULL, 0);
       fb_len = jchunk.len;
     }
-    esp_camera_fb_return(fb);
+    frame_return(fb);
     int64_t fr_end = esp_timer_get_time();
     Serial.printf("JPG: %uB %ums\n", (uint32_t)(fb_len), (uint32_t)((fr_end - fr_start) / 1000));
     return res;
@@ -135,6 +166,160 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   return res;
 }
 
+// Onboard vision: visual odometry and the floor classifier share one decoded frame,
+// fed from the stream while it runs and from vision_task otherwise. Nothing is
+// allocated or decoded until one of them is turned on.
+#define ODOM_HFOV_DEG 60
+
+typedef struct {
+  uint8_t rgb[ODOM_MAX_W * ODOM_MAX_H * 3];
+  uint8_t gray[ODOM_MAX_W * ODOM_MAX_H];
+  odom_t odom;
+  floor_t floor;
+} vision_t;
+
+static vision_t * vision = NULL;
+static SemaphoreHandle_t vision_lock = NULL;
+static volatile bool stream_active = false;
+static int odometry_enabled = 0;
+static int floor_enabled = 0;
+static int floor_stop = 0;
+static int floor_stop_cells = 6;
+static volatile bool floor_calibrate_next = false;
+static volatile int floor_front_obstacles = 0;
+static int vision_period_ms = 100;
+static int last_car = 0;
+
+typedef struct {
+  const uint8_t * src;
+  size_t len;
+  uint8_t * rgb;
+  int width;
+  int height;
+} vision_decode_t;
+
+static size_t vision_jpg_read(void * arg, size_t index, uint8_t * buf, size_t len) {
+  vision_decode_t * d = (vision_decode_t *)arg;
+  if (index + len > d->len) {
+    len = d->len - index;
+  }
+  if (buf) {
+    memcpy(buf, d->src + index, len);
+  }
+  return len;
+}
+
+static bool vision_jpg_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t * data) {
+  vision_decode_t * d = (vision_decode_t *)arg;
+  if (!data || x >= d->width) {
+    return true;
+  }
+  int n = x + w <= d->width ? w : d->width - x;
+  for (int r = 0; r < h && y + r < d->height; r++) {
+    memcpy(d->rgb + ((y + r) * d->width + x) * 3, data + r * w * 3, n * 3);
+  }
+  return true;
+}
+
+// Stops the car when it drives forward into cells that do not look like the floor
+static void floor_check_stop() {
+  if (floor_stop && vision->floor.calibrated && robo && last_car == 1 &&
+      floor_front_obstacles >= floor_stop_cells) {
+    Serial.println("Obstacle stop");
+    robot_stop();
+    robo = 0;
+  }
+}
+
+static void vision_feed(camera_fb_t * fb) {
+  if (!vision || !(odometry_enabled || floor_enabled) || fb->format != PIXFORMAT_JPEG) {
+    return;
+  }
+  if (xSemaphoreTake(vision_lock, 0) != pdTRUE) {
+    return;
+  }
+  // Decode at the smallest scale that fits, the decimation comes for free from the JPEG DCT
+  jpg_scale_t scale = JPG_SCALE_NONE;
+  int width = fb->width;
+  int height = fb->height;
+  while ((width > ODOM_MAX_W || height > ODOM_MAX_H) && scale < JPG_SCALE_8X) {
+    scale = (jpg_scale_t)(scale + 1);
+    width /= 2;
+    height /= 2;
+  }
+  uint8_t * rgb = vision->rgb;
+  uint8_t * gray = vision->gray;
+  odom_t * odom = &vision->odom;
+  floor_t * floor_grid = &vision->floor;
+  vision_decode_t d = {fb->buf, fb->len, rgb, width, height};
+  if (width <= ODOM_MAX_W && height <= ODOM_MAX_H &&
+      esp_jpg_decode(fb->len, scale, vision_jpg_read, vision_jpg_write, &d) == ESP_OK) {
+    if (odometry_enabled) {
+      if (width != odom->width || height != odom->height) {
+        odom_init(odom, width, height, ODOM_HFOV_DEG);
+      }
+      for (int i = 0; i < width * height; i++) {
+        const uint8_t * px = rgb + i * 3;
+        // (R + 2G + B) / 4 does not depend on the decoder's channel order
+        gray[i] = (px[0] + 2 * px[1] + px[2]) >> 2;
+      }
+      odom_update(odom, gray, esp_timer_get_time());
+    }
+    if (floor_enabled && width >= FLOOR_COLS && height >= FLOOR_ROWS) {
+      floor_features(floor_grid, rgb, width, height);
+      if (floor_calibrate_next) {
+        floor_calibrate(floor_grid, FLOOR_REF_ROW0, FLOOR_ROWS, FLOOR_REF_COL0, FLOOR_REF_COL1);
+        floor_calibrate_next = false;
+      }
+      floor_classify(floor_grid);
+      floor_front_obstacles = floor_obstacles(floor_grid, FLOOR_FRONT_ROW0, FLOOR_ROWS,
+                                              FLOOR_FRONT_COL0, FLOOR_FRONT_COL1);
+      floor_check_stop();
+    }
+  }
+  xSemaphoreGive(vision_lock);
+}
+
+static void vision_task(void * arg) {
+  for (;;) {
+    if ((odometry_enabled || floor_enabled) && !stream_active) {
+      camera_fb_t * fb = frame_get();
+      if (fb) {
+        vision_feed(fb);
+        frame_return(fb);
+      }
+    }
+    vTaskDelay(vision_period_ms / portTICK_PERIOD_MS);
+  }
+}
+
+// Allocates the vision state, in PSRAM when the board has it, and starts vision_task
+// the first time odometry or the floor classifier is turned on. Returns 0 on success.
+static int vision_start() {
+  if (vision) {
+    return 0;
+  }
+  uint32_t caps = (psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+  vision_t * v = (vision_t *)alloc_trace_malloc(ALLOC_VISION, sizeof(vision_t), caps);
+  if (!v) {
+    Serial.println("Vision alloc failed");
+    return -1;
+  }
+  memset(v, 0, sizeof(vision_t));
+  floor_init(&v->floor);
+  vision_lock = xSemaphoreCreateMutex();
+  vision = v;
+  // Runs on the app core, next to the Arduino loop, leaving the WiFi core alone
+  xTaskCreatePinnedToCore(vision_task, "vision", 4096, NULL, 1, NULL, 1);
+  return 0;
+}
+
+void startVision() {
+  if (odometry_enabled || floor_enabled) {
+    vision_start();
+  }
+}
+
 static esp_err_t stream_handler(httpd_req_t *req) {
   camera_fb_t * fb = NULL;
   esp_err_t res = ESP_OK;
@@ -153,8 +338,10 @@ static esp_err_t stream_handler(httpd_req_t *req) {
     return res;
   }
 
+  stream_active = true;
+  int64_t last_vision = 0;
   while (true) {
-    fb = esp_camera_fb_get();
+    fb = frame_get();
     if (!fb) {
       Serial.println("Camera capture failed");
       res = ESP_FAIL;
@@ -162,15 +349,22 @@ static esp_err_t stream_handler(httpd_req_t *req) {
       {
         if (fb->format != PIXFORMAT_JPEG) {
           bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-          esp_camera_fb_return(fb);
+          frame_return(fb);
           fb = NULL;
           if (!jpeg_converted) {
             Serial.println("JPEG compression failed");
+            alloc_trace_fail(ALLOC_JPEG);
             res = ESP_FAIL;
+          } else {
+            alloc_trace_add(ALLOC_JPEG, _jpg_buf, FRAME2JPG_BUF_LEN);
           }
         } else {
           _jpg_buf_len = fb->len;
           _jpg_buf = fb->buf;
+          if (esp_timer_get_time() - last_vision >= vision_period_ms * 1000LL) {
+            last_vision = esp_timer_get_time();
+            vision_feed(fb);
+          }
         }
       }
     }
@@ -185,10 +379,11 @@ static esp_err_t stream_handler(httpd_req_t *req) {
       res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
     }
     if (fb) {
-      esp_camera_fb_return(fb);
+      frame_return(fb);
       fb = NULL;
       _jpg_buf = NULL;
     } else if (_jpg_buf) {
+      alloc_trace_remove(ALLOC_JPEG, _jpg_buf, FRAME2JPG_BUF_LEN);
       free(_jpg_buf);
       _jpg_buf = NULL;
     }
@@ -199,6 +394,7 @@ static esp_err_t stream_handler(httpd_req_t *req) {
     int64_t frame_time = fr_end - last_frame;
     last_frame = fr_end;
     frame_time /= 1000;
+    stream_fps_x10 = frame_time ? 10000 / (uint32_t)frame_time : 0;
     Serial.printf("MJPG: %uB %ums (%.1ffps)\n",
                   (uint32_t)(_jpg_buf_len),
                   (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time
@@ -206,116 +402,474 @@ static esp_err_t stream_handler(httpd_req_t *req) {
   }
 
   last_frame = 0;
+  stream_fps_x10 = 0;
+  stream_active = false;
   return res;
 }
 
-enum state {fwd, rev, stp};
-state actstate = stp;
+// Client sockets of both servers come from the CONFIG_LWIP_MAX_SOCKETS pool, which each
+// server also takes two from (listen and control). The stream handler keeps the stream
+// server's task for a whole stream, so a second stream client could not be served before
+// the first one leaves anyway and one client socket is enough there.
+#define STREAM_HTTPD_SOCKETS         1
+#define CAMERA_HTTPD_SOCKETS         (CONFIG_LWIP_MAX_SOCKETS - 4 - STREAM_HTTPD_SOCKETS)
+// camera_httpd sockets kept for /control, /status, /capture and the UI
+#define CAMERA_HTTPD_REQUEST_SOCKETS 3
 
-static esp_err_t cmd_handler(httpd_req_t *req)
-{
-  char*  buf;
-  size_t buf_len;
-  char variable[32] = {0,};
-  char value[32] = {0,};
+// Telemetry pushed to subscribers of /events as Server-Sent Events. Every subscriber
+// holds a camera_httpd socket for good, so they get what the requests leave over.
+#define TELEMETRY_MAX_SUBSCRIBERS (CAMERA_HTTPD_SOCKETS - CAMERA_HTTPD_REQUEST_SOCKETS)
+static_assert(TELEMETRY_MAX_SUBSCRIBERS >= 1, "no camera_httpd socket left for /events");
 
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = (char*)malloc(buf_len);
-    if (!buf) {
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
-    }
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-      if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) == ESP_OK &&
-          httpd_query_key_value(buf, "val", value, sizeof(value)) == ESP_OK) {
-      } else {
-        free(buf);
-        httpd_resp_send_404(req);
-        return ESP_FAIL;
-      }
-    } else {
-      free(buf);
-      httpd_resp_send_404(req);
-      return ESP_FAIL;
+enum {
+  TELEMETRY_FRAMESIZE = 1 << 0,
+  TELEMETRY_QUALITY   = 1 << 1,
+  TELEMETRY_ROBO      = 1 << 2,
+  TELEMETRY_SPEED     = 1 << 3,
+  TELEMETRY_MOTORS    = 1 << 4,
+  TELEMETRY_FPS       = 1 << 5,
+  TELEMETRY_RSSI      = 1 << 6,
+  TELEMETRY_FLOOR     = 1 << 7,
+  TELEMETRY_ALL       = (1 << 8) - 1
+};
+
+// Names accepted in /events?fields=..., in bit order
+static const char* telemetry_names[] = {"framesize", "quality", "robo", "speed", "motors", "fps", "rssi", "floor"};
+
+typedef struct {
+  bool active;
+  int fd;
+  uint32_t fields;
+} telemetry_subscriber_t;
+
+// Only touched from the camera_httpd task (handler, session close and queued work)
+static telemetry_subscriber_t telemetry_subscribers[TELEMETRY_MAX_SUBSCRIBERS];
+static volatile int telemetry_count = 0;
+static int telemetry_period_ms = 200;
+static esp_timer_handle_t telemetry_timer = NULL;
+
+// Floor mask as a string of 8 hex digits per row, top row first, bit 0 is the leftmost cell
+static char * append_floor_mask(char * p) {
+  static const char hex[] = "0123456789abcdef";
+  *p++ = '"';
+  for (int r = 0; r < FLOOR_ROWS; r++) {
+    uint32_t bits = vision ? vision->floor.mask[r] : 0;
+    for (int shift = 28; shift >= 0; shift -= 4) {
+      *p++ = hex[(bits >> shift) & 0xf];
     }
-    free(buf);
-  } else {
-    httpd_resp_send_404(req);
-    return ESP_FAIL;
   }
+  *p++ = '"';
+  return p;
+}
 
-  int val = atoi(value);
-  sensor_t * s = esp_camera_sensor_get();
-  int res = 0;
+static char * append_key(char * p, const char * key) {
+  *p++ = ',';
+  *p++ = '"';
+  p = append_str(p, key);
+  *p++ = '"';
+  *p++ = ':';
+  return p;
+}
 
-// Look at values within URL to determine function
-  if (!strcmp(variable, "framesize"))
-  {
-    Serial.println("framesize");
-    if (s->pixformat == PIXFORMAT_JPEG) res = s->set_framesize(s, (framesize_t)val);
+static size_t telemetry_snapshot(char * buf, uint32_t fields) {
+  sensor_t * s = esp_camera_sensor_get();
+  char * p = append_str(buf, "data: {\"t\":");
+  p = append_uint(p, millis());
+  if (fields & TELEMETRY_FRAMESIZE) {
+    p = append_uint(append_key(p, "framesize"), s->status.framesize);
   }
-  else if (!strcmp(variable, "quality"))
-  {
-    Serial.println("quality");
-    res = s->set_quality(s, val);
+  if (fields & TELEMETRY_QUALITY) {
+    p = append_uint(append_key(p, "quality"), s->status.quality);
   }
-  else if (!strcmp(variable, "flash"))
-  {
-    ledcWrite(7, val);
+  if (fields & TELEMETRY_ROBO) {
+    p = append_uint(append_key(p, "robo"), robo);
   }
-  else if (!strcmp(variable, "flashoff"))
-  {
-    ledcWrite(7, val);
+  if (fields & TELEMETRY_SPEED) {
+    p = append_int(append_key(p, "speed"), speed);
   }
-  else if (!strcmp(variable, "speed"))
-  {
-    if      (val > 255) val = 255;
-    else if (val <   0) val = 0;
-    speed = val;
-    //ledcWrite(8, speed);
-    //ledcWrite(9, speed);
+  if (fields & TELEMETRY_MOTORS) {
+    // Bit n is set when motor LEDC channel 3 + n has a non-zero duty
+    uint32_t motors = 0;
+    for (int ch = 3; ch <= 6; ch++) {
+      if (ledcRead(ch)) motors |= 1 << (ch - 3);
+    }
+    p = append_uint(append_key(p, "motors"), motors);
   }
-  else if (!strcmp(variable, "nostop"))
-  {
-    noStop = val;
+  if (fields & TELEMETRY_FPS) {
+    uint32_t fps = stream_fps_x10;
+    p = append_uint(append_key(p, "fps"), fps / 10);
+    *p++ = '.';
+    *p++ = '0' + fps % 10;
   }
-  else if (!strcmp(variable, "car")) {
-    if (val == 1) {
-      Serial.println("Forward");
-      robot_fwd();
-      robo = 1;
-    }
-    else if (val == 2) {
-      Serial.println("TurnLeft");
-      robot_left();
-      robo = 1;
-    }
-    else if (val == 3) {
-      Serial.println("Stop");
-      robot_stop();
+  if (fields & TELEMETRY_RSSI) {
+    p = append_int(append_key(p, "rssi"), WiFi.RSSI());
+  }
+  if (fields & TELEMETRY_FLOOR) {
+    p = append_floor_mask(append_key(p, "floor"));
+  }
+  p = append_str(p, "}\n\n");
+  return p - buf;
+}
+
+// Matched by socket, so the session close of a subscriber that telemetry_push already
+// dropped cannot clear the slot after a new subscriber has taken it
+static void telemetry_unsubscribe(int fd) {
+  for (int i = 0; i < TELEMETRY_MAX_SUBSCRIBERS; i++) {
+    telemetry_subscriber_t * sub = &telemetry_subscribers[i];
+    if (sub->active && sub->fd == fd) {
+      sub->active = false;
+      telemetry_count--;
     }
-    else if (val == 4) {
-      Serial.println("TurnRight");
-      robot_right();
-      robo = 1;
+  }
+}
+
+// Session context of a subscriber is its socket rather than a pointer to its slot
+static void telemetry_free_ctx(void * ctx) {
+  telemetry_unsubscribe((int)(intptr_t)ctx);
+}
+
+static void telemetry_push(void * arg) {
+  static char buf[512];
+  size_t len = 0;
+  uint32_t fields = 0;
+  for (int i = 0; i < TELEMETRY_MAX_SUBSCRIBERS; i++) {
+    telemetry_subscriber_t * sub = &telemetry_subscribers[i];
+    if (!sub->active) {
+      continue;
+    }
+    // Subscribers asking for the same fields share one serialization
+    if (!len || sub->fields != fields) {
+      fields = sub->fields;
+      len = telemetry_snapshot(buf, fields);
+    }
+    // Never block the httpd task, which also serves /control: a subscriber whose
+    // socket cannot take the whole snapshot right now is dropped instead of waited for
+    int fd = sub->fd;
+    if (httpd_socket_send(camera_httpd, fd, buf, len, MSG_DONTWAIT) != (int)len) {
+      telemetry_unsubscribe(fd);
+      httpd_sess_trigger_close(camera_httpd, fd);
     }
-    else if (val == 5) {
-      Serial.println("Backward");
-      robot_back();
-      robo = 1;
+  }
+}
+
+static void telemetry_tick(void * arg) {
+  if (telemetry_count) {
+    httpd_queue_work(camera_httpd, telemetry_push, NULL);
+  }
+}
+
+// The timer is only created once somebody subscribes
+static void telemetry_start() {
+  if (telemetry_timer) {
+    return;
+  }
+  esp_timer_create_args_t telemetry_timer_args = {
+      .callback = telemetry_tick,
+      .arg = NULL,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "telemetry"
+  };
+  if (esp_timer_create(&telemetry_timer_args, &telemetry_timer) == ESP_OK) {
+    esp_timer_start_periodic(telemetry_timer, (uint64_t)telemetry_period_ms * 1000);
+  } else {
+    telemetry_timer = NULL;
+  }
+}
+
+static uint32_t telemetry_parse_fields(const char * list) {
+  uint32_t fields = 0;
+  while (*list) {
+    const char * end = strchr(list, ',');
+    size_t len = end ? end - list : strlen(list);
+    for (size_t i = 0; i < sizeof(telemetry_names) / sizeof(telemetry_names[0]); i++) {
+      if (strlen(telemetry_names[i]) == len && !strncmp(list, telemetry_names[i], len)) {
+        fields |= 1 << i;
+      }
     }
-    if (noStop != 1)
-    {
+    list += len;
+    if (*list) list++;
+  }
+  return fields;
+}
+
+static esp_err_t events_handler(httpd_req_t *req) {
+  static const char* header = "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/event-stream\r\n"
+                              "Cache-Control: no-cache\r\n"
+                              "Access-Control-Allow-Origin: *\r\n\r\n";
+  char query[96];
+  char value[80];
+  uint32_t fields = TELEMETRY_ALL;
+
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "fields", value, sizeof(value)) == ESP_OK) {
+    fields = telemetry_parse_fields(value);
+  }
 
+  telemetry_subscriber_t * sub = NULL;
+  for (int i = 0; i < TELEMETRY_MAX_SUBSCRIBERS; i++) {
+    if (!telemetry_subscribers[i].active) {
+      sub = &telemetry_subscribers[i];
+      break;
     }
   }
-  else
-  {
-    Serial.println("variable");
-    res = -1;
+  if (!sub) {
+    Serial.println("Too many telemetry subscribers");
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  // Headers are sent raw so the session stays open after the handler returns,
+  // snapshots are then written to the socket by telemetry_push
+  if (httpd_send(req, header, strlen(header)) < 0) {
+    return ESP_FAIL;
+  }
+  sub->fd = httpd_req_to_sockfd(req);
+  sub->fields = fields;
+  sub->active = true;
+  telemetry_count++;
+  telemetry_start();
+  req->sess_ctx = (void *)(intptr_t)sub->fd;
+  req->free_ctx = telemetry_free_ctx;
+  return ESP_OK;
+}
+
+enum state {fwd, rev, stp};
+state actstate = stp;
+
+// Setters and getters of the /control parameters, registered in robot_params
+
+static int set_framesize(int val) {
+  Serial.println("framesize");
+  sensor_t * s = esp_camera_sensor_get();
+  if (s->pixformat != PIXFORMAT_JPEG) return 0;
+  return s->set_framesize(s, (framesize_t)val);
+}
+
+static int get_framesize() {
+  return esp_camera_sensor_get()->status.framesize;
+}
+
+static int set_quality(int val) {
+  Serial.println("quality");
+  sensor_t * s = esp_camera_sensor_get();
+  return s->set_quality(s, val);
+}
+
+static int get_quality() {
+  return esp_camera_sensor_get()->status.quality;
+}
+
+static int set_flash(int val) {
+  ledcWrite(7, val);
+  return 0;
+}
+
+static int get_flash() {
+  return ledcRead(7);
+}
+
+static int set_speed(int val) {
+  speed = val;
+  //ledcWrite(8, speed);
+  //ledcWrite(9, speed);
+  return 0;
+}
+
+static int get_speed_param() {
+  return speed;
+}
+
+static int set_nostop(int val) {
+  noStop = val;
+  return 0;
+}
+
+static int get_nostop() {
+  return noStop;
+}
+
+static int set_car(int val) {
+  last_car = val;
+  if (val == 1) {
+    Serial.println("Forward");
+    robot_fwd();
+    robo = 1;
+  }
+  else if (val == 2) {
+    Serial.println("TurnLeft");
+    robot_left();
+    robo = 1;
+  }
+  else if (val == 3) {
+    Serial.println("Stop");
+    robot_stop();
+  }
+  else if (val == 4) {
+    Serial.println("TurnRight");
+    robot_right();
+    robo = 1;
+  }
+  else if (val == 5) {
+    Serial.println("Backward");
+    robot_back();
+    robo = 1;
+  }
+  return 0;
+}
+
+static int set_telemetry(int val) {
+  telemetry_period_ms = val;
+  if (!telemetry_timer) {
+    return 0;
+  }
+  esp_timer_stop(telemetry_timer);
+  return esp_timer_start_periodic(telemetry_timer, (uint64_t)telemetry_period_ms * 1000);
+}
+
+static int get_telemetry() {
+  return telemetry_period_ms;
+}
+
+static int set_odometry(int val) {
+  if (val && vision_start()) {
+    return -1;
+  }
+  odometry_enabled = val;
+  return 0;
+}
+
+static int get_odometry() {
+  return odometry_enabled;
+}
+
+// Heading in hundredths of a degree, writing it sets the current heading
+static int set_odom_heading(int val) {
+  if (!vision) {
+    return -1;
+  }
+  xSemaphoreTake(vision_lock, portMAX_DELAY);
+  vision->odom.state.heading_q16 = (int32_t)(((int64_t)val << 16) / 100);
+  xSemaphoreGive(vision_lock);
+  return 0;
+}
+
+static int get_odom_heading() {
+  return vision ? (int32_t)(((int64_t)vision->odom.state.heading_q16 * 100) >> 16) : 0;
+}
+
+// Forward motion in hundredths of a decimated frame pixel, writing it sets the current value
+static int set_odom_forward(int val) {
+  if (!vision) {
+    return -1;
+  }
+  xSemaphoreTake(vision_lock, portMAX_DELAY);
+  vision->odom.state.forward_q8 = (int32_t)(((int64_t)val << 8) / 100);
+  xSemaphoreGive(vision_lock);
+  return 0;
+}
+
+static int get_odom_forward() {
+  return vision ? (int32_t)(((int64_t)vision->odom.state.forward_q8 * 100) >> 8) : 0;
+}
+
+// Time of the last frame used, in ms since boot like the telemetry "t"
+static int get_odom_time() {
+  return vision ? (int)(vision->odom.state.timestamp_us / 1000) : 0;
+}
+
+static int set_floor(int val) {
+  if (val && vision_start()) {
+    return -1;
+  }
+  floor_enabled = val;
+  return 0;
+}
+
+static int get_floor() {
+  return floor_enabled;
+}
+
+// Takes the floor model from the next frame, reads back whether it is calibrated
+static int set_floorcal(int val) {
+  if (val) {
+    floor_calibrate_next = true;
   }
+  return 0;
+}
+
+static int get_floorcal() {
+  return vision ? vision->floor.calibrated : 0;
+}
+
+static int set_floorstop(int val) {
+  floor_stop = val;
+  return 0;
+}
+
+static int get_floorstop() {
+  return floor_stop;
+}
+
+// Obstacle cells in front of the robot that stop it
+static int set_floorstop_cells(int val) {
+  floor_stop_cells = val;
+  return 0;
+}
+
+static int get_floorstop_cells() {
+  return floor_stop_cells;
+}
+
+static int get_floor_front() {
+  return floor_front_obstacles;
+}
+
+struct robot_params {
+  static constexpr param_t list[] = {
+    ROBOT_PARAMS(PARAM_ENTRY)
+  };
+  static constexpr size_t count = sizeof(list) / sizeof(list[0]);
+};
+constexpr param_t robot_params::list[];
+
+typedef param_registry<robot_params> robot_registry;
+
+static void log_param(const char * name) {
+  Serial.println(name);
+}
+
+static esp_err_t cmd_handler(httpd_req_t *req)
+{
+  char*  buf;
+  size_t buf_len;
+  int res = 0;
+  int applied = 0;
 
+  buf_len = httpd_req_get_url_query_len(req) + 1;
+  if (buf_len <= 1) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+  buf = (char*)alloc_trace_malloc(ALLOC_QUERY, buf_len, MALLOC_CAP_8BIT);
+  if (!buf) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+  if (httpd_req_get_url_query_str(req, buf, buf_len) != ESP_OK) {
+    alloc_trace_free(buf);
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+
+  // Either /control?var=speed&val=200 or several parameters at once, /control?speed=200&quality=12
+  res = robot_registry::set_query(buf, &applied, log_param);
+  alloc_trace_free(buf);
+
+  if (!applied) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -327,17 +881,25 @@ static esp_err_t cmd_handler(httpd_req_t *req)
 static esp_err_t status_handler(httpd_req_t *req) {
   static char json_response[1024];
 
-  sensor_t * s = esp_camera_sensor_get();
-  char * p = json_response;
-  *p++ = '{';
+  char * p = robot_registry::serialize(json_response);
+  if (floor_enabled) {
+    // The mask of the last classified frame, reopening the object for it
+    p = append_str(p - 1, ",\"floor_mask\":");
+    p = append_floor_mask(p);
+    *p++ = '}';
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json_response, p - json_response);
+}
+
+static esp_err_t heap_handler(httpd_req_t *req) {
+  static char json_response[2048];
 
-  p += sprintf(p, "\"framesize\":%u,", s->status.framesize);
-  p += sprintf(p, "\"quality\":%u,", s->status.quality);
-  *p++ = '}';
-  *p++ = 0;
+  char * p = alloc_trace_json(json_response);
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  return httpd_resp_send(req, json_response, strlen(json_response));
+  return httpd_resp_send(req, json_response, p - json_response);
 }
 
 static const char PROGMEM INDEX_HTML[] = R"rawliteral(
@@ -727,6 +1289,7 @@ static esp_err_t index_handler(httpd_req_t *req){
 void startCameraServer()
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_open_sockets = CAMERA_HTTPD_SOCKETS;
 
     httpd_uri_t index_uri = {
         .uri       = "/",
@@ -756,6 +1319,20 @@ void startCameraServer()
         .user_ctx  = NULL
     };
 
+    httpd_uri_t heap_uri = {
+        .uri       = "/heap",
+        .method    = HTTP_GET,
+        .handler   = heap_handler,
+        .user_ctx  = NULL
+    };
+
+    httpd_uri_t events_uri = {
+        .uri       = "/events",
+        .method    = HTTP_GET,
+        .handler   = events_handler,
+        .user_ctx  = NULL
+    };
+
    httpd_uri_t stream_uri = {
         .uri       = "/stream",
         .method    = HTTP_GET,
@@ -769,10 +1346,13 @@ void startCameraServer()
         httpd_register_uri_handler(camera_httpd, &cmd_uri);
         httpd_register_uri_handler(camera_httpd, &status_uri);
         httpd_register_uri_handler(camera_httpd, &capture_uri);
+        httpd_register_uri_handler(camera_httpd, &events_uri);
+        httpd_register_uri_handler(camera_httpd, &heap_uri);
     }
 
     config.server_port += 1;
     config.ctrl_port += 1;
+    config.max_open_sockets = STREAM_HTTPD_SOCKETS;
     Serial.printf("Starting stream server on port: '%d'\n", config.server_port);
     if (httpd_start(&stream_httpd, &config) == ESP_OK) {
         httpd_register_uri_handler(stream_httpd, &stream_uri);
@@ -0,0 +1,137 @@
+/*
+  ESP32_CAM_Robot_Car
+  floor.cpp
+  Floor / obstacle classifier over a coarse grid of the onboard camera view
+
+*/
+
+#include "floor.h"
+#include <string.h>
+
+static inline int luma(const uint8_t * px) {
+  return (px[0] + 2 * px[1] + px[2]) >> 2;
+}
+
+static inline int absdiff(int a, int b) {
+  return a > b ? a - b : b - a;
+}
+
+void floor_init(floor_t * fl) {
+  memset(fl, 0, sizeof(*fl));
+  // Best grid accuracy in test/floor_eval.cpp, 3 lets grey walls pass as a grey floor
+  fl->tolerance = 2;
+}
+
+void floor_features(floor_t * fl, const uint8_t * rgb, int width, int height) {
+  // One row of cells is accumulated at a time to keep the stack small
+  uint32_t sum[FLOOR_COLS][5];
+  for (int cy = 0; cy < FLOOR_ROWS; cy++) {
+    memset(sum, 0, sizeof(sum));
+    int y0 = cy * height / FLOOR_ROWS;
+    int y1 = (cy + 1) * height / FLOOR_ROWS;
+    for (int y = y0; y < y1; y++) {
+      const uint8_t * row = rgb + y * width * 3;
+      for (int x = 0; x < width; x++) {
+        const uint8_t * px = row + x * 3;
+        uint32_t * s = sum[x * FLOOR_COLS / width];
+        int l = luma(px);
+        s[0] += px[0];
+        s[1] += px[1];
+        s[2] += px[2];
+        s[3] += (x + 1 < width ? absdiff(luma(px + 3), l) : 0) +
+                (y + 1 < height ? absdiff(luma(px + width * 3), l) : 0);
+        s[4]++;
+      }
+    }
+    for (int cx = 0; cx < FLOOR_COLS; cx++) {
+      uint32_t * s = sum[cx];
+      floor_cell_t * cell = &fl->cells[cy][cx];
+      uint32_t total = s[0] + s[1] + s[2];
+      uint32_t n = s[4] ? s[4] : 1;
+      cell->cr = total ? s[0] * 256 / total : 85;
+      cell->cg = total ? s[1] * 256 / total : 85;
+      cell->luma = total / (3 * n);
+      cell->texture = s[3] / n;
+    }
+  }
+}
+
+void floor_calibrate(floor_t * fl, int row0, int row1, int col0, int col1) {
+  int n = (row1 - row0) * (col1 - col0);
+  if (n <= 0) {
+    return;
+  }
+  int32_t mean[4] = {0, 0, 0, 0};
+  int32_t dev[4] = {0, 0, 0, 0};
+  for (int r = row0; r < row1; r++) {
+    for (int c = col0; c < col1; c++) {
+      const floor_cell_t * cell = &fl->cells[r][c];
+      mean[0] += cell->cr;
+      mean[1] += cell->cg;
+      mean[2] += cell->luma;
+      mean[3] += cell->texture;
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    mean[i] /= n;
+  }
+  for (int r = row0; r < row1; r++) {
+    for (int c = col0; c < col1; c++) {
+      const floor_cell_t * cell = &fl->cells[r][c];
+      dev[0] += absdiff(cell->cr, mean[0]);
+      dev[1] += absdiff(cell->cg, mean[1]);
+      dev[2] += absdiff(cell->luma, mean[2]);
+      dev[3] += absdiff(cell->texture, mean[3]);
+    }
+  }
+  // Lower bounds keep a very uniform reference patch from rejecting sensor noise
+  static const int32_t min_spread[4] = {4, 4, 10, 3};
+  int16_t spread[4];
+  for (int i = 0; i < 4; i++) {
+    spread[i] = dev[i] / n > min_spread[i] ? dev[i] / n : min_spread[i];
+  }
+  fl->mean.cr = mean[0];
+  fl->mean.cg = mean[1];
+  fl->mean.luma = mean[2];
+  fl->mean.texture = mean[3];
+  fl->spread.cr = spread[0];
+  fl->spread.cg = spread[1];
+  fl->spread.luma = spread[2];
+  fl->spread.texture = spread[3];
+  fl->calibrated = true;
+}
+
+void floor_classify(floor_t * fl) {
+  const floor_cell_t * m = &fl->mean;
+  const floor_cell_t * s = &fl->spread;
+  int k = fl->tolerance;
+  for (int r = 0; r < FLOOR_ROWS; r++) {
+    uint32_t bits = 0;
+    if (fl->calibrated) {
+      for (int c = 0; c < FLOOR_COLS; c++) {
+        const floor_cell_t * cell = &fl->cells[r][c];
+        // Colour must match closely, brightness may vary more under shadows,
+        // and only texture above the floor's counts against a cell
+        if (absdiff(cell->cr, m->cr) <= k * s->cr &&
+            absdiff(cell->cg, m->cg) <= k * s->cg &&
+            absdiff(cell->luma, m->luma) <= 2 * k * s->luma &&
+            cell->texture <= m->texture + k * s->texture) {
+          bits |= 1u << c;
+        }
+      }
+    }
+    fl->mask[r] = bits;
+  }
+}
+
+int floor_obstacles(const floor_t * fl, int row0, int row1, int col0, int col1) {
+  int count = 0;
+  for (int r = row0; r < row1; r++) {
+    for (int c = col0; c < col1; c++) {
+      if (!(fl->mask[r] & (1u << c))) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
@@ -0,0 +1,62 @@
+/*
+  ESP32_CAM_Robot_Car
+  floor.h
+  Floor / obstacle classifier over a coarse grid of the onboard camera view
+
+  The frame is split into FLOOR_ROWS x FLOOR_COLS cells and each cell is
+  described by its chromaticity, brightness and texture. A reference patch
+  known to be floor (by default the bottom centre of the view) calibrates
+  the floor model, and every cell within tolerance of it is marked as floor
+  in a bitmask with one 32-bit word per row. Integer only, portable C++.
+*/
+
+#ifndef FLOOR_H
+#define FLOOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLOOR_COLS 32
+#define FLOOR_ROWS 24
+
+// Reference patch for floor_calibrate, the bottom centre of the view right in front of the robot
+#define FLOOR_REF_ROW0   (FLOOR_ROWS - 4)
+#define FLOOR_REF_COL0   (FLOOR_COLS / 2 - 4)
+#define FLOOR_REF_COL1   (FLOOR_COLS / 2 + 4)
+
+// Cells just in front of the robot, rows FLOOR_FRONT_ROW0 to the bottom, checked by the obstacle stop
+#define FLOOR_FRONT_ROW0 16
+#define FLOOR_FRONT_COL0 10
+#define FLOOR_FRONT_COL1 22
+
+typedef struct {
+  int16_t cr;       // R share of R+G+B in Q8
+  int16_t cg;       // G share of R+G+B in Q8
+  int16_t luma;     // mean brightness
+  int16_t texture;  // mean absolute gradient of the brightness
+} floor_cell_t;
+
+typedef struct {
+  floor_cell_t cells[FLOOR_ROWS][FLOOR_COLS];
+  floor_cell_t mean;     // floor model, from floor_calibrate
+  floor_cell_t spread;   // mean absolute deviation of the reference cells
+  bool calibrated;
+  int tolerance;         // how many spreads a floor cell may be away from the mean
+  uint32_t mask[FLOOR_ROWS];  // bit c of mask[r] is set when cell (r, c) is floor
+} floor_t;
+
+void floor_init(floor_t * fl);
+
+// Fills fl->cells from a width x height RGB888 image, width and height at least the grid size
+void floor_features(floor_t * fl, const uint8_t * rgb, int width, int height);
+
+// Builds the floor model from the cells in rows [row0, row1) and columns [col0, col1)
+void floor_calibrate(floor_t * fl, int row0, int row1, int col0, int col1);
+
+// Updates fl->mask from fl->cells, all zero until calibrated
+void floor_classify(floor_t * fl);
+
+// Cells that are not floor in rows [row0, row1) and columns [col0, col1)
+int floor_obstacles(const floor_t * fl, int row0, int row1, int col0, int col1);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+  ESP32_CAM_Robot_Car
+  odometry.cpp
+  Visual odometry from the onboard camera
+
+*/
+
+#include "odometry.h"
+#include <string.h>
+
+#define ODOM_SPAN (2 * ODOM_SEARCH + 1)
+
+static inline uint32_t absdiff(uint8_t a, uint8_t b) {
+  return a > b ? a - b : b - a;
+}
+
+// Sum of horizontal and vertical gradients, flat blocks cannot be matched reliably
+static uint32_t block_texture(const uint8_t * img, int stride) {
+  uint32_t sum = 0;
+  for (int r = 0; r < ODOM_BLOCK - 1; r++) {
+    const uint8_t * row = img + r * stride;
+    for (int c = 0; c < ODOM_BLOCK - 1; c++) {
+      sum += absdiff(row[c + 1], row[c]) + absdiff(row[c + stride], row[c]);
+    }
+  }
+  return sum;
+}
+
+static uint32_t block_sad(const uint8_t * a, const uint8_t * b, int stride) {
+  uint32_t sum = 0;
+  for (int r = 0; r < ODOM_BLOCK; r++) {
+    const uint8_t * ra = a + r * stride;
+    const uint8_t * rb = b + r * stride;
+    for (int c = 0; c < ODOM_BLOCK; c++) {
+      sum += absdiff(ra[c], rb[c]);
+    }
+  }
+  return sum;
+}
+
+// Sub-pixel minimum from the SADs at -1, 0 and +1 in Q8, fitting a symmetric V
+// which is less biased than a parabola for absolute differences
+static int32_t subpixel_q8(uint32_t sm, uint32_t s0, uint32_t sp) {
+  int32_t den = 2 * ((int32_t)(sm > sp ? sm : sp) - (int32_t)s0);
+  if (den <= 0) {
+    return 0;
+  }
+  return ((int32_t)sm - (int32_t)sp) * 256 / den;
+}
+
+static int32_t median(int32_t * v, int n) {
+  for (int i = 1; i < n; i++) {
+    int32_t x = v[i];
+    int j = i - 1;
+    while (j >= 0 && v[j] > x) {
+      v[j + 1] = v[j];
+      j--;
+    }
+    v[j + 1] = x;
+  }
+  return v[n / 2];
+}
+
+int odom_motion(const uint8_t * prev, const uint8_t * cur, int width, int height,
+                uint32_t min_texture, int32_t * dx_q8, int32_t * dy_q8) {
+  int32_t dxs[ODOM_MAX_BLOCKS];
+  int32_t dys[ODOM_MAX_BLOCKS];
+  uint32_t sad[ODOM_SPAN][ODOM_SPAN];
+  int n = 0;
+
+  for (int by = ODOM_SEARCH; by + ODOM_BLOCK + ODOM_SEARCH <= height; by += ODOM_BLOCK) {
+    for (int bx = ODOM_SEARCH; bx + ODOM_BLOCK + ODOM_SEARCH <= width; bx += ODOM_BLOCK) {
+      const uint8_t * block = prev + by * width + bx;
+      if (n >= ODOM_MAX_BLOCKS || block_texture(block, width) < min_texture) {
+        continue;
+      }
+      int best_x = 0;
+      int best_y = 0;
+      uint32_t best = UINT32_MAX;
+      for (int y = 0; y < ODOM_SPAN; y++) {
+        const uint8_t * row = cur + (by + y - ODOM_SEARCH) * width + bx - ODOM_SEARCH;
+        for (int x = 0; x < ODOM_SPAN; x++) {
+          sad[y][x] = block_sad(block, row + x, width);
+          if (sad[y][x] < best) {
+            best = sad[y][x];
+            best_x = x;
+            best_y = y;
+          }
+        }
+      }
+      int32_t dx = (best_x - ODOM_SEARCH) * 256;
+      int32_t dy = (best_y - ODOM_SEARCH) * 256;
+      if (best_x > 0 && best_x < ODOM_SPAN - 1) {
+        dx += subpixel_q8(sad[best_y][best_x - 1], sad[best_y][best_x], sad[best_y][best_x + 1]);
+      }
+      if (best_y > 0 && best_y < ODOM_SPAN - 1) {
+        dy += subpixel_q8(sad[best_y - 1][best_x], sad[best_y][best_x], sad[best_y + 1][best_x]);
+      }
+      dxs[n] = dx;
+      dys[n] = dy;
+      n++;
+    }
+  }
+
+  // The median keeps blocks on moving objects or repeated texture from skewing the estimate
+  if (n < 3) {
+    return 0;
+  }
+  *dx_q8 = median(dxs, n);
+  *dy_q8 = median(dys, n);
+  return n;
+}
+
+void odom_init(odom_t * od, int width, int height, int hfov_deg) {
+  od->width = width < ODOM_MAX_W ? width : ODOM_MAX_W;
+  od->height = height < ODOM_MAX_H ? height : ODOM_MAX_H;
+  od->deg_per_px_q16 = (int32_t)(((int64_t)hfov_deg << 16) / od->width);
+  od->min_texture = 400;
+  odom_reset(od);
+}
+
+void odom_reset(odom_t * od) {
+  od->has_prev = false;
+  memset(&od->state, 0, sizeof(od->state));
+}
+
+void odom_update(odom_t * od, const uint8_t * gray, int64_t timestamp_us) {
+  odom_state_t * st = &od->state;
+  if (od->has_prev) {
+    int32_t dx = 0;
+    int32_t dy = 0;
+    st->blocks = odom_motion(od->prev, gray, od->width, od->height, od->min_texture, &dx, &dy);
+    st->dx_q8 = dx;
+    st->dy_q8 = dy;
+    // Turning right moves the scene left, moving forward moves the floor down the frame
+    st->heading_q16 -= (int32_t)(((int64_t)dx * od->deg_per_px_q16) >> 8);
+    st->forward_q8 += dy;
+  }
+  memcpy(od->prev, gray, od->width * od->height);
+  od->has_prev = true;
+  st->frames++;
+  st->timestamp_us = timestamp_us;
+}
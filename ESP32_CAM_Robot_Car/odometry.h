@@ -0,0 +1,58 @@
+/*
+  ESP32_CAM_Robot_Car
+  odometry.h
+  Visual odometry from the onboard camera
+
+  Global image motion between consecutive decimated grayscale frames is
+  found by block matching (SAD with a sub-pixel parabola fit) on the
+  textured blocks of a grid, and the median block vector is integrated
+  into a heading and a forward estimate. Everything is integer fixed
+  point and portable C++, so the same code runs on the ESP32 and on Linux.
+*/
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Largest frame accepted, QVGA decoded at 1/4 scale
+#define ODOM_MAX_W      80
+#define ODOM_MAX_H      60
+#define ODOM_BLOCK      8
+#define ODOM_SEARCH     4
+#define ODOM_MAX_BLOCKS ((ODOM_MAX_W / ODOM_BLOCK) * (ODOM_MAX_H / ODOM_BLOCK))
+
+typedef struct {
+  int32_t heading_q16;   // integrated heading, degrees in Q16, positive to the right
+  int32_t forward_q8;    // integrated forward motion, frame pixels in Q8
+  int32_t dx_q8;         // horizontal motion of the last frame, pixels in Q8
+  int32_t dy_q8;         // vertical motion of the last frame, pixels in Q8
+  uint16_t blocks;       // blocks that agreed on the last motion, 0 if it was rejected
+  uint32_t frames;       // frames processed
+  int64_t timestamp_us;  // capture time of the last frame processed
+} odom_state_t;
+
+typedef struct {
+  uint8_t prev[ODOM_MAX_W * ODOM_MAX_H];
+  int width;
+  int height;
+  bool has_prev;
+  int32_t deg_per_px_q16;   // heading change per pixel of horizontal motion
+  uint32_t min_texture;     // gradient energy a block needs to be matched
+  odom_state_t state;
+} odom_t;
+
+// hfov_deg is the horizontal field of view across width pixels
+void odom_init(odom_t * od, int width, int height, int hfov_deg);
+void odom_reset(odom_t * od);
+
+// Median motion of cur relative to prev in Q8 pixels, returns the number of
+// blocks used or 0 when too few textured blocks were found
+int odom_motion(const uint8_t * prev, const uint8_t * cur, int width, int height,
+                uint32_t min_texture, int32_t * dx_q8, int32_t * dy_q8);
+
+// Feeds a width x height grayscale frame captured at timestamp_us
+void odom_update(odom_t * od, const uint8_t * gray, int64_t timestamp_us);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+  ESP32_CAM_Robot_Car
+  params.h
+  Compile-time registry of the /control parameters
+
+  Each parameter is declared once in a list of param_t. From that list the
+  registry builds, at compile time, a perfect hash from name to parameter
+  used by /control, and serializes every readable parameter for /status.
+  Written for C++11 constexpr so it builds with the ESP32 Arduino core.
+  The compile-time searches split their ranges in halves, so the constexpr
+  and template recursion depth grows with the log of the parameter count.
+*/
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  PARAM_INT,   // clamped to [min, max]
+  PARAM_BOOL,  // any non-zero value is stored as 1
+  PARAM_ENUM   // values outside [min, max] are rejected
+} param_type_t;
+
+typedef struct {
+  const char * name;
+  param_type_t type;
+  int min;
+  int max;
+  int (*set)(int val);  // returns 0 on success, like the sensor setters, NULL for read-only parameters
+  int (*get)();         // NULL for write-only parameters, left out of /status
+} param_t;
+
+// Expands one entry of an X-macro parameter list such as ROBOT_PARAMS in robot_params.h
+#define PARAM_ENTRY(name, type, min, max, set, get) {name, type, min, max, set, get},
+
+// Called with the name of every parameter /control failed to set
+typedef void (*param_log_t)(const char * name);
+
+// String builders shared by the JSON writers, they do not NUL terminate
+
+static inline char * append_str(char * p, const char * str) {
+  while (*str) {
+    *p++ = *str++;
+  }
+  return p;
+}
+
+static inline char * append_uint(char * p, uint32_t val) {
+  char digits[10];
+  int n = 0;
+  do {
+    digits[n++] = '0' + val % 10;
+    val /= 10;
+  } while (val);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+static inline char * append_int(char * p, int32_t val) {
+  if (val < 0) {
+    *p++ = '-';
+    return append_uint(p, -(uint32_t)val);
+  }
+  return append_uint(p, val);
+}
+
+// FNV-1a of a name, computed once per parameter
+constexpr uint32_t param_hash(const char * s, uint32_t h) {
+  return *s ? param_hash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+constexpr uint32_t param_xorshift(uint32_t x, int shift) {
+  return x ^ (x >> shift);
+}
+
+// Remixes a name hash with a seed (the murmur3 finalizer), so searching for a collision
+// free seed does not hash the names again
+constexpr uint32_t param_mix(uint32_t h, uint32_t seed) {
+  return param_xorshift(param_xorshift(param_xorshift(h ^ seed * 0x9e3779b9u, 16) * 0x85ebca6bu, 13) * 0xc2b2ae35u, 16);
+}
+
+constexpr uint32_t param_slot(const char * name, uint32_t seed, uint32_t mask) {
+  return param_mix(param_hash(name, 2166136261u), seed) & mask;
+}
+
+// Seeds tried for a table size before the table is doubled
+#define PARAM_SEED_TRIES 256
+#define PARAM_NO_SEED    0xffffffffu
+
+// The searches below work on the name hashes h[] of the parameters
+
+// Whether one of h[lo, hi) falls in slot
+constexpr bool param_in_slot(const uint32_t * h, size_t lo, size_t hi, uint32_t seed, uint32_t mask, uint32_t slot) {
+  return hi - lo == 0 ? false :
+         hi - lo == 1 ? (param_mix(h[lo], seed) & mask) == slot :
+         param_in_slot(h, lo, lo + (hi - lo) / 2, seed, mask, slot) ||
+         param_in_slot(h, lo + (hi - lo) / 2, hi, seed, mask, slot);
+}
+
+// Whether one of h[a0, a1) shares a slot with one of h[b0, b1)
+constexpr bool param_cross(const uint32_t * h, size_t a0, size_t a1, size_t b0, size_t b1, uint32_t seed, uint32_t mask) {
+  return a1 - a0 == 0 ? false :
+         a1 - a0 == 1 ? param_in_slot(h, b0, b1, seed, mask, param_mix(h[a0], seed) & mask) :
+         param_cross(h, a0, a0 + (a1 - a0) / 2, b0, b1, seed, mask) ||
+         param_cross(h, a0 + (a1 - a0) / 2, a1, b0, b1, seed, mask);
+}
+
+// Whether two of h[lo, hi) share a slot
+constexpr bool param_collides(const uint32_t * h, size_t lo, size_t hi, uint32_t seed, uint32_t mask) {
+  return hi - lo < 2 ? false :
+         param_collides(h, lo, lo + (hi - lo) / 2, seed, mask) ||
+         param_collides(h, lo + (hi - lo) / 2, hi, seed, mask) ||
+         param_cross(h, lo, lo + (hi - lo) / 2, lo + (hi - lo) / 2, hi, seed, mask);
+}
+
+constexpr uint32_t param_first_seed(const uint32_t * h, size_t n, uint32_t mask, uint32_t lo, uint32_t hi);
+
+constexpr uint32_t param_seed_or(uint32_t seed, const uint32_t * h, size_t n, uint32_t mask, uint32_t lo, uint32_t hi) {
+  return seed != PARAM_NO_SEED ? seed : param_first_seed(h, n, mask, lo, hi);
+}
+
+// Lowest collision free seed in [lo, hi), PARAM_NO_SEED if there is none
+constexpr uint32_t param_first_seed(const uint32_t * h, size_t n, uint32_t mask, uint32_t lo, uint32_t hi) {
+  return hi - lo == 1 ? (param_collides(h, 0, n, lo, mask) ? PARAM_NO_SEED : lo) :
+         param_seed_or(param_first_seed(h, n, mask, lo, lo + (hi - lo) / 2), h, n, mask, lo + (hi - lo) / 2, hi);
+}
+
+// A random seed is collision free with a chance of about exp(-n^2 / 2 size), so the table
+// starts at n^2 / 8 slots, and at least twice the parameter count, where one of the first
+// PARAM_SEED_TRIES seeds almost always works: 64 slots for 17 parameters, 2048 for 100
+constexpr uint32_t param_min_size(size_t n, uint32_t size) {
+  return size >= 2 * n && 8 * size >= n * n ? size : param_min_size(n, size * 2);
+}
+
+constexpr uint32_t param_table_size(const uint32_t * h, size_t n, uint32_t size) {
+  return param_first_seed(h, n, size - 1, 0, PARAM_SEED_TRIES) != PARAM_NO_SEED ? size :
+         param_table_size(h, n, size * 2);
+}
+
+constexpr int param_owner(const uint32_t * h, size_t lo, size_t hi, uint32_t seed, uint32_t mask, uint32_t slot);
+
+constexpr int param_owner_or(int i, const uint32_t * h, size_t lo, size_t hi, uint32_t seed, uint32_t mask, uint32_t slot) {
+  return i >= 0 ? i : param_owner(h, lo, hi, seed, mask, slot);
+}
+
+// Index of the one of h[lo, hi) in slot, -1 if the slot is free
+constexpr int param_owner(const uint32_t * h, size_t lo, size_t hi, uint32_t seed, uint32_t mask, uint32_t slot) {
+  return hi - lo == 0 ? -1 :
+         hi - lo == 1 ? ((param_mix(h[lo], seed) & mask) == slot ? (int)lo : -1) :
+         param_owner_or(param_owner(h, lo, lo + (hi - lo) / 2, seed, mask, slot), h, lo + (hi - lo) / 2, hi, seed, mask, slot);
+}
+
+template<int... I> struct param_seq {};
+template<class A, class B> struct param_concat;
+template<int... I, int... J> struct param_concat<param_seq<I...>, param_seq<J...> > {
+  typedef param_seq<I..., (int)sizeof...(I) + J...> type;
+};
+template<int N> struct param_make_seq :
+  param_concat<typename param_make_seq<N / 2>::type, typename param_make_seq<N - N / 2>::type> {};
+template<> struct param_make_seq<0> { typedef param_seq<> type; };
+template<> struct param_make_seq<1> { typedef param_seq<0> type; };
+
+// Name hashes of the parameters of P
+template<class P, class S> struct param_hashes;
+template<class P, int... I> struct param_hashes<P, param_seq<I...> > {
+  static constexpr uint32_t value[sizeof...(I)] = { param_hash(P::list[I].name, 2166136261u)... };
+};
+template<class P, int... I>
+constexpr uint32_t param_hashes<P, param_seq<I...> >::value[sizeof...(I)];
+
+// Copies the value of key in a query such as "var=speed&val=200" to val, NUL terminated,
+// returns false when key is absent or its value does not fit in len bytes
+static inline bool param_query_value(const char * query, const char * key, char * val, size_t len) {
+  size_t key_len = strlen(key);
+  const char * p = query;
+  while (p) {
+    if (!strncmp(p, key, key_len) && p[key_len] == '=') {
+      const char * v = p + key_len + 1;
+      size_t n = strcspn(v, "&");
+      if (n >= len) {
+        return false;
+      }
+      memcpy(val, v, n);
+      val[n] = 0;
+      return true;
+    }
+    p = strchr(p, '&');
+    if (p) p++;
+  }
+  return false;
+}
+
+// P is a struct with "static constexpr param_t list[]" and "static constexpr size_t count"
+template<class P> struct param_registry {
+  static_assert(P::count < 128, "slot table entries are int8_t");
+  typedef param_hashes<P, typename param_make_seq<P::count>::type> hashes;
+  static constexpr uint32_t size = param_table_size(hashes::value, P::count, param_min_size(P::count, 1));
+  static constexpr uint32_t mask = size - 1;
+  static constexpr uint32_t seed = param_first_seed(hashes::value, P::count, mask, 0, PARAM_SEED_TRIES);
+
+  template<class S> struct slots;
+  template<int... I> struct slots<param_seq<I...> > {
+    static constexpr int8_t table[sizeof...(I)] = { (int8_t)param_owner(hashes::value, 0, P::count, seed, mask, I)... };
+  };
+  typedef slots<typename param_make_seq<size>::type> slot_table;
+
+  static const param_t * find(const char * name) {
+    int i = slot_table::table[param_slot(name, seed, mask)];
+    if (i < 0 || strcmp(P::list[i].name, name)) {
+      return NULL;
+    }
+    return &P::list[i];
+  }
+
+  // Applies val to the parameter called name, returns 0 on success
+  static int set(const char * name, int val) {
+    const param_t * param = find(name);
+    if (!param || !param->set) {
+      return -1;
+    }
+    switch (param->type) {
+      case PARAM_INT:
+        if      (val > param->max) val = param->max;
+        else if (val < param->min) val = param->min;
+        break;
+      case PARAM_BOOL:
+        val = val ? 1 : 0;
+        break;
+      case PARAM_ENUM:
+        if (val < param->min || val > param->max) return -1;
+        break;
+    }
+    return param->set(val);
+  }
+
+  // Applies a /control query, either var=speed&val=200 or several parameters at once as in
+  // speed=200&quality=12. Counts the parameters in applied and returns non-zero if any of
+  // them failed, passing its name to log. query is modified.
+  static int set_query(char * query, int * applied, param_log_t log) {
+    char variable[32];
+    char value[32];
+    if (param_query_value(query, "var", variable, sizeof(variable)) &&
+        param_query_value(query, "val", value, sizeof(value))) {
+      *applied = 1;
+      if (set(variable, atoi(value))) {
+        if (log) log(variable);
+        return -1;
+      }
+      return 0;
+    }
+    int res = 0;
+    *applied = 0;
+    char * key = query;
+    while (key) {
+      char * next = strchr(key, '&');
+      if (next) *next++ = 0;
+      char * val = strchr(key, '=');
+      if (val) {
+        *val++ = 0;
+        if (set(key, atoi(val))) {
+          if (log) log(key);
+          res = -1;
+        }
+        (*applied)++;
+      }
+      key = next;
+    }
+    return res;
+  }
+
+  // Writes {"name":value,...} for every readable parameter and returns the end
+  static char * serialize(char * p) {
+    *p++ = '{';
+    bool first = true;
+    for (size_t i = 0; i < P::count; i++) {
+      if (!P::list[i].get) {
+        continue;
+      }
+      if (!first) {
+        *p++ = ',';
+      }
+      first = false;
+      *p++ = '"';
+      p = append_str(p, P::list[i].name);
+      *p++ = '"';
+      *p++ = ':';
+      p = append_int(p, P::list[i].get());
+    }
+    *p++ = '}';
+    return p;
+  }
+};
+
+template<class P> template<int... I>
+constexpr int8_t param_registry<P>::slots<param_seq<I...> >::table[sizeof...(I)];
+
+#endif
@@ -0,0 +1,35 @@
+/*
+  ESP32_CAM_Robot_Car
+  robot_params.h
+  The /control parameters of the robot, as an X-macro list for params.h
+
+  P(name, type, min, max, setter, getter) is expanded once per parameter.
+  app_httpd.cpp builds robot_registry from it with PARAM_ENTRY, and
+  test/params_test.cpp builds the same registry against stub setters.
+  framesize starts at 0 since the first frame size differs between camera
+  driver versions, FRAMESIZE_UXGA is the largest on all of them.
+*/
+
+#ifndef ROBOT_PARAMS_H
+#define ROBOT_PARAMS_H
+
+#define ROBOT_PARAMS(P) \
+  P("framesize",    PARAM_ENUM, 0,  FRAMESIZE_UXGA, set_framesize, get_framesize) \
+  P("quality",      PARAM_INT,  0,  63,   set_quality,   get_quality) \
+  P("flash",        PARAM_INT,  0,  256,  set_flash,     get_flash) \
+  P("flashoff",     PARAM_INT,  0,  256,  set_flash,     NULL) \
+  P("speed",        PARAM_INT,  0,  255,  set_speed,     get_speed_param) \
+  P("nostop",       PARAM_BOOL, 0,  1,    set_nostop,    get_nostop) \
+  P("car",          PARAM_ENUM, 1,  5,    set_car,       NULL) \
+  P("telemetry",    PARAM_INT,  20, 5000, set_telemetry, get_telemetry) \
+  P("odometry",     PARAM_BOOL, 0,  1,    set_odometry,  get_odometry) \
+  P("odom_heading", PARAM_INT,  -3000000,   3000000,   set_odom_heading, get_odom_heading) \
+  P("odom_forward", PARAM_INT,  -100000000, 100000000, set_odom_forward, get_odom_forward) \
+  P("odom_time",    PARAM_INT,  0,  0,    NULL,          get_odom_time) \
+  P("floor",        PARAM_BOOL, 0,  1,    set_floor,     get_floor) \
+  P("floorcal",     PARAM_BOOL, 0,  1,    set_floorcal,  get_floorcal) \
+  P("floorstop",    PARAM_BOOL, 0,  1,    set_floorstop, get_floorstop) \
+  P("floorstop_cells", PARAM_INT, 1, 96,  set_floorstop_cells, get_floorstop_cells) \
+  P("floor_front",  PARAM_INT,  0,  0,    NULL,          get_floor_front)
+
+#endif
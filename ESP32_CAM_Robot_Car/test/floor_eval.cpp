@@ -0,0 +1,187 @@
+/*
+  ESP32_CAM_Robot_Car
+  test/floor_eval.cpp
+  Host evaluation of the floor classifier on a session recorded by TraceRecorder
+
+  Frames are decoded at the size the robot decodes and classified the way vision_feed
+  does it, calibrating on the bottom centre patch of the first frame. Frames with a
+  label image, labels/NNNNNN.pgm as written by label_trace in playground.ipynb
+  (255 floor, 0 obstacle, any size), are scored cell by cell against it, over the
+  whole grid and over the region in front of the robot that floorstop watches.
+
+  g++ -std=gnu++11 -Wall -O2 -o floor_eval floor_eval.cpp ../floor.cpp -ljpeg
+  ./floor_eval <trace dir> [tolerance] [floorstop_cells]
+*/
+
+#include "../floor.h"
+#include "trace.h"
+
+// Same decoded size as vision_feed in app_httpd.cpp
+#define FLOOR_MAX_W      80
+#define FLOOR_MAX_H      60
+
+typedef struct {
+  int floor_floor;        // floor cells classified as floor
+  int floor_obstacle;     // floor cells classified as obstacle, false stops
+  int obstacle_floor;     // obstacle cells classified as floor, missed obstacles
+  int obstacle_obstacle;  // obstacle cells classified as obstacle
+} confusion_t;
+
+// Binary PGM (P5) as written by cv2.imwrite, returns NULL when absent or malformed
+static uint8_t * read_pgm(const char * path, int * width, int * height) {
+  FILE * f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  int w = 0, h = 0, maxval = 0;
+  if (fscanf(f, "P5 %d %d %d", &w, &h, &maxval) != 3 || maxval != 255 || w <= 0 || h <= 0) {
+    fclose(f);
+    return NULL;
+  }
+  fgetc(f);
+  uint8_t * img = (uint8_t *)malloc(w * h);
+  if (fread(img, 1, w * h, f) != (size_t)(w * h)) {
+    free(img);
+    img = NULL;
+  }
+  fclose(f);
+  *width = w;
+  *height = h;
+  return img;
+}
+
+// Label per grid cell, floor when at least half its pixels are floor, split like floor_features
+static bool label_grid(const char * dir, int n, uint32_t * mask) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/labels/%06d.pgm", dir, n);
+  int w, h;
+  uint8_t * label = read_pgm(path, &w, &h);
+  if (!label) {
+    return false;
+  }
+  for (int cy = 0; cy < FLOOR_ROWS; cy++) {
+    mask[cy] = 0;
+    for (int cx = 0; cx < FLOOR_COLS; cx++) {
+      int floor = 0;
+      int total = 0;
+      for (int y = cy * h / FLOOR_ROWS; y < (cy + 1) * h / FLOOR_ROWS; y++) {
+        for (int x = cx * w / FLOOR_COLS; x < (cx + 1) * w / FLOOR_COLS; x++) {
+          floor += label[y * w + x] >= 128;
+          total++;
+        }
+      }
+      if (2 * floor >= total) {
+        mask[cy] |= 1u << cx;
+      }
+    }
+  }
+  free(label);
+  return true;
+}
+
+static void score(const uint32_t * truth, const uint32_t * mask, int row0, int row1, int col0, int col1,
+                  confusion_t * m) {
+  for (int r = row0; r < row1; r++) {
+    for (int c = col0; c < col1; c++) {
+      bool t = truth[r] & (1u << c);
+      bool p = mask[r] & (1u << c);
+      m->floor_floor += t && p;
+      m->floor_obstacle += t && !p;
+      m->obstacle_floor += !t && p;
+      m->obstacle_obstacle += !t && !p;
+    }
+  }
+}
+
+static void print_confusion(const char * name, const confusion_t * m) {
+  int floor = m->floor_floor + m->floor_obstacle;
+  int obstacle = m->obstacle_floor + m->obstacle_obstacle;
+  int total = floor + obstacle;
+  printf("%s: %d cells, accuracy %.1f%%, floor kept %.1f%%, obstacles found %.1f%%\n", name, total,
+         total ? 100.0 * (m->floor_floor + m->obstacle_obstacle) / total : 0.0,
+         floor ? 100.0 * m->floor_floor / floor : 0.0,
+         obstacle ? 100.0 * m->obstacle_obstacle / obstacle : 0.0);
+}
+
+int main(int argc, char ** argv) {
+  if (argc < 2) {
+    printf("usage: %s <trace dir> [tolerance] [floorstop_cells]\n", argv[0]);
+    return 2;
+  }
+  const char * dir = argv[1];
+  trace_frame_t * frames = NULL;
+  int count = trace_frames(dir, &frames);
+  if (count < 0) {
+    printf("cannot read %s/events.jsonl\n", dir);
+    return 1;
+  }
+  static floor_t fl;
+  floor_init(&fl);
+  if (argc > 2) {
+    fl.tolerance = atoi(argv[2]);
+  }
+  int stop_cells = argc > 3 ? atoi(argv[3]) : 6;
+
+  confusion_t grid = {0, 0, 0, 0};
+  confusion_t front = {0, 0, 0, 0};
+  int stops[2][2] = {{0, 0}, {0, 0}};  // [labelled stop][classifier stop]
+  int decoded = 0;
+  int labelled = 0;
+  int width = 0, height = 0;
+  double total_us = 0;
+  double worst_us = 0;
+  for (int i = 0; i < count; i++) {
+    uint8_t * rgb = trace_decode(dir, frames[i].n, FLOOR_MAX_W, FLOOR_MAX_H, &width, &height);
+    if (!rgb) {
+      continue;
+    }
+    if (width < FLOOR_COLS || height < FLOOR_ROWS) {
+      free(rgb);
+      continue;
+    }
+    double t = trace_now_us();
+    floor_features(&fl, rgb, width, height);
+    if (!fl.calibrated) {
+      floor_calibrate(&fl, FLOOR_REF_ROW0, FLOOR_ROWS, FLOOR_REF_COL0, FLOOR_REF_COL1);
+    }
+    floor_classify(&fl);
+    int found = floor_obstacles(&fl, FLOOR_FRONT_ROW0, FLOOR_ROWS, FLOOR_FRONT_COL0, FLOOR_FRONT_COL1);
+    double dt = trace_now_us() - t;
+    free(rgb);
+    total_us += dt;
+    worst_us = dt > worst_us ? dt : worst_us;
+    decoded++;
+
+    uint32_t truth[FLOOR_ROWS];
+    if (!label_grid(dir, frames[i].n, truth)) {
+      continue;
+    }
+    labelled++;
+    score(truth, fl.mask, 0, FLOOR_ROWS, 0, FLOOR_COLS, &grid);
+    confusion_t here = {0, 0, 0, 0};
+    score(truth, fl.mask, FLOOR_FRONT_ROW0, FLOOR_ROWS, FLOOR_FRONT_COL0, FLOOR_FRONT_COL1, &here);
+    int expected = here.obstacle_floor + here.obstacle_obstacle;
+    stops[expected >= stop_cells][found >= stop_cells]++;
+    front.floor_floor += here.floor_floor;
+    front.floor_obstacle += here.floor_obstacle;
+    front.obstacle_floor += here.obstacle_floor;
+    front.obstacle_obstacle += here.obstacle_obstacle;
+  }
+  free(frames);
+  if (!decoded) {
+    printf("no frame decoded\n");
+    return 1;
+  }
+  printf("%d frames at %dx%d, tolerance %d, %.1f us per frame, worst %.1f us\n",
+         decoded, width, height, fl.tolerance, total_us / decoded, worst_us);
+  if (!labelled) {
+    printf("no labels/NNNNNN.pgm, accuracy not measured\n");
+    return 0;
+  }
+  printf("%d labelled frames\n", labelled);
+  print_confusion("grid ", &grid);
+  print_confusion("front", &front);
+  printf("floorstop at %d cells: %d stops, %d missed, %d false\n", stop_cells,
+         stops[1][1], stops[1][0], stops[0][1]);
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+  ESP32_CAM_Robot_Car
+  test/odometry_eval.cpp
+  Host evaluation of the visual odometry on a session recorded by TraceRecorder
+
+  The recorded sequence is run through odom_update at the size the robot decodes,
+  reporting the time per frame and the integrated heading and forward motion.
+  Every recorded frame is then shifted by known sub-pixel offsets and odom_motion
+  is compared against them, which gives the error of the estimate on real images.
+
+  g++ -std=gnu++11 -Wall -O2 -o odometry_eval odometry_eval.cpp ../odometry.cpp -ljpeg
+  ./odometry_eval <trace dir> [hfov_deg]
+*/
+
+#include "../odometry.h"
+#include "trace.h"
+#include <math.h>
+
+// Offsets are made on a frame decoded at twice the size and box filtered back down,
+// so odd offsets are half pixels of the downsampled frame
+#define SHIFT_MAX  6
+#define FINE_W     (2 * ODOM_MAX_W)
+#define FINE_H     (2 * ODOM_MAX_H)
+#define CROP_W     (ODOM_MAX_W - SHIFT_MAX)
+#define CROP_H     (ODOM_MAX_H - SHIFT_MAX)
+
+static uint8_t * fine_gray(const char * dir, int n, int * width, int * height) {
+  uint8_t * rgb = trace_decode(dir, n, FINE_W, FINE_H, width, height);
+  if (!rgb) {
+    return NULL;
+  }
+  uint8_t * gray = (uint8_t *)malloc(*width * *height);
+  trace_gray(rgb, gray, *width * *height);
+  free(rgb);
+  return gray;
+}
+
+// CROP_W x CROP_H window at x0, y0 of the fine frame, halved with a 2x2 box filter
+static void crop_half(const uint8_t * fine, int stride, int x0, int y0, uint8_t * out) {
+  for (int r = 0; r < CROP_H; r++) {
+    const uint8_t * a = fine + (y0 + 2 * r) * stride + x0;
+    const uint8_t * b = a + stride;
+    for (int c = 0; c < CROP_W; c++) {
+      out[r * CROP_W + c] = (a[2 * c] + a[2 * c + 1] + b[2 * c] + b[2 * c + 1] + 2) >> 2;
+    }
+  }
+}
+
+static void run_sequence(const char * dir, const trace_frame_t * frames, int count, int hfov) {
+  static odom_t od;
+  static uint8_t gray[ODOM_MAX_W * ODOM_MAX_H];
+  od.width = 0;
+  double total_us = 0;
+  double worst_us = 0;
+  int used = 0;
+  int rejected = 0;
+  for (int i = 0; i < count; i++) {
+    int w, h;
+    uint8_t * rgb = trace_decode(dir, frames[i].n, ODOM_MAX_W, ODOM_MAX_H, &w, &h);
+    if (!rgb) {
+      continue;
+    }
+    if (w != od.width || h != od.height) {
+      odom_init(&od, w, h, hfov);
+    }
+    trace_gray(rgb, gray, w * h);
+    free(rgb);
+    double t = trace_now_us();
+    odom_update(&od, gray, (int64_t)(frames[i].t * 1e6));
+    double dt = trace_now_us() - t;
+    if (od.state.frames > 1) {
+      total_us += dt;
+      worst_us = dt > worst_us ? dt : worst_us;
+      used++;
+      rejected += od.state.blocks == 0;
+    }
+  }
+  if (!used) {
+    printf("sequence: fewer than two frames decoded\n");
+    return;
+  }
+  printf("sequence: %d frames at %dx%d, %.1f us per frame, worst %.1f us, %d rejected\n",
+         used + 1, od.width, od.height, total_us / used, worst_us, rejected);
+  printf("sequence: heading %.2f deg, forward %.1f px\n",
+         od.state.heading_q16 / 65536.0, od.state.forward_q8 / 256.0);
+}
+
+static void run_shifts(const char * dir, const trace_frame_t * frames, int count) {
+  static uint8_t prev[CROP_W * CROP_H];
+  static uint8_t cur[CROP_W * CROP_H];
+  double sum_abs = 0;
+  double sum_sq = 0;
+  double worst = 0;
+  double total_us = 0;
+  int pairs = 0;
+  int rejected = 0;
+  for (int i = 0; i < count; i++) {
+    int w, h;
+    uint8_t * fine = fine_gray(dir, frames[i].n, &w, &h);
+    if (!fine) {
+      continue;
+    }
+    if (w < 2 * ODOM_MAX_W || h < 2 * ODOM_MAX_H) {
+      free(fine);
+      continue;
+    }
+    // Centred window, so every offset stays inside the frame
+    int x0 = (w - 2 * CROP_W) / 2;
+    int y0 = (h - 2 * CROP_H) / 2;
+    crop_half(fine, w, x0, y0, prev);
+    for (int sy = -SHIFT_MAX; sy <= SHIFT_MAX; sy += 3) {
+      for (int sx = -SHIFT_MAX; sx <= SHIFT_MAX; sx++) {
+        // Moving the window by s moves the image content by -s
+        crop_half(fine, w, x0 + sx, y0 + sy, cur);
+        int32_t dx = 0;
+        int32_t dy = 0;
+        double t = trace_now_us();
+        int blocks = odom_motion(prev, cur, CROP_W, CROP_H, 400, &dx, &dy);
+        total_us += trace_now_us() - t;
+        pairs++;
+        if (!blocks) {
+          rejected++;
+          continue;
+        }
+        double ex = dx / 256.0 + sx / 2.0;
+        double ey = dy / 256.0 + sy / 2.0;
+        double e = sqrt(ex * ex + ey * ey);
+        sum_abs += fabs(ex) + fabs(ey);
+        sum_sq += ex * ex + ey * ey;
+        worst = e > worst ? e : worst;
+      }
+    }
+    free(fine);
+  }
+  int matched = pairs - rejected;
+  if (!matched) {
+    printf("shifts: no frame at least %dx%d with enough texture\n", FINE_W, FINE_H);
+    return;
+  }
+  printf("shifts: %d pairs at %dx%d, offsets up to %.1f px in 0.5 px steps, %d rejected\n",
+         pairs, CROP_W, CROP_H, SHIFT_MAX / 2.0, rejected);
+  printf("shifts: mean abs error %.3f px per axis, rms %.3f px, worst %.3f px, %.1f us per pair\n",
+         sum_abs / (2 * matched), sqrt(sum_sq / (2 * matched)), worst, total_us / pairs);
+}
+
+int main(int argc, char ** argv) {
+  if (argc < 2) {
+    printf("usage: %s <trace dir> [hfov_deg]\n", argv[0]);
+    return 2;
+  }
+  int hfov = argc > 2 ? atoi(argv[2]) : 60;
+  trace_frame_t * frames = NULL;
+  int count = trace_frames(argv[1], &frames);
+  if (count < 0) {
+    printf("cannot read %s/events.jsonl\n", argv[1]);
+    return 1;
+  }
+  run_sequence(argv[1], frames, count, hfov);
+  run_shifts(argv[1], frames, count);
+  free(frames);
+  return 0;
+}
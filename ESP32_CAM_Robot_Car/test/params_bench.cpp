@@ -0,0 +1,129 @@
+/*
+  ESP32_CAM_Robot_Car
+  test/params_bench.cpp
+  Host micro-benchmark of /control dispatch: the params.h registry against the
+  strcmp chain cmd_handler used before it
+
+  g++ -std=gnu++11 -Wall -O2 -o params_bench params_bench.cpp && ./params_bench
+*/
+
+#include "../params.h"
+#include <stdio.h>
+#include <time.h>
+
+static volatile int sink;
+
+static int set_value(int val) {
+  sink = val;
+  return 0;
+}
+
+static int get_value() {
+  return sink;
+}
+
+struct bench_params {
+  static constexpr param_t list[] = {
+    {"framesize",    PARAM_ENUM, 0,  10,   set_value, get_value},
+    {"quality",      PARAM_INT,  0,  63,   set_value, get_value},
+    {"flash",        PARAM_INT,  0,  256,  set_value, get_value},
+    {"flashoff",     PARAM_INT,  0,  256,  set_value, NULL},
+    {"speed",        PARAM_INT,  0,  255,  set_value, get_value},
+    {"nostop",       PARAM_BOOL, 0,  1,    set_value, get_value},
+    {"car",          PARAM_ENUM, 1,  5,    set_value, NULL},
+    {"telemetry",    PARAM_INT,  20, 5000, set_value, get_value},
+    {"odometry",     PARAM_BOOL, 0,  1,    set_value, get_value},
+    {"odom_heading", PARAM_INT,  -3000000,   3000000,   set_value, get_value},
+    {"odom_forward", PARAM_INT,  -100000000, 100000000, set_value, get_value},
+    {"odom_time",    PARAM_INT,  0,  0,    NULL,      get_value},
+    {"floor",        PARAM_BOOL, 0,  1,    set_value, get_value},
+    {"floorcal",     PARAM_BOOL, 0,  1,    set_value, get_value},
+    {"floorstop",    PARAM_BOOL, 0,  1,    set_value, get_value},
+    {"floorstop_cells", PARAM_INT, 1, 96,  set_value, get_value},
+    {"floor_front",  PARAM_INT,  0,  0,    NULL,      get_value},
+  };
+  static constexpr size_t count = sizeof(list) / sizeof(list[0]);
+};
+constexpr param_t bench_params::list[];
+
+typedef param_registry<bench_params> registry;
+
+// The if / else if chain of strcmp the handler had, extended to the same names
+static int chain_set(const char * variable, int val) {
+  int res = 0;
+  if (!strcmp(variable, "framesize")) res = set_value(val);
+  else if (!strcmp(variable, "quality")) res = set_value(val);
+  else if (!strcmp(variable, "flash")) res = set_value(val);
+  else if (!strcmp(variable, "flashoff")) res = set_value(val);
+  else if (!strcmp(variable, "speed")) res = set_value(val);
+  else if (!strcmp(variable, "nostop")) res = set_value(val);
+  else if (!strcmp(variable, "car")) res = set_value(val);
+  else if (!strcmp(variable, "telemetry")) res = set_value(val);
+  else if (!strcmp(variable, "odometry")) res = set_value(val);
+  else if (!strcmp(variable, "odom_heading")) res = set_value(val);
+  else if (!strcmp(variable, "odom_forward")) res = set_value(val);
+  else if (!strcmp(variable, "floor")) res = set_value(val);
+  else if (!strcmp(variable, "floorcal")) res = set_value(val);
+  else if (!strcmp(variable, "floorstop")) res = set_value(val);
+  else if (!strcmp(variable, "floorstop_cells")) res = set_value(val);
+  else res = -1;
+  return res;
+}
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Names are copied to a buffer so the compiler cannot fold the lookups
+static char names[32][24];
+static int name_count = 0;
+
+static void add_name(const char * name) {
+  strncpy(names[name_count++], name, sizeof(names[0]) - 1);
+}
+
+static double bench(int (*set)(const char *, int), int rounds) {
+  double best = 1e18;
+  for (int run = 0; run < 5; run++) {
+    double t = now_ns();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < name_count; i++) {
+        set(names[i], r & 1);
+      }
+    }
+    double dt = (now_ns() - t) / ((double)rounds * name_count);
+    if (dt < best) {
+      best = dt;
+    }
+  }
+  return best;
+}
+
+int main() {
+  const char * writable[] = {"framesize", "quality", "flash", "flashoff", "speed", "nostop", "car",
+                             "telemetry", "odometry", "odom_heading", "odom_forward", "floor",
+                             "floorcal", "floorstop", "floorstop_cells"};
+  for (size_t i = 0; i < sizeof(writable) / sizeof(writable[0]); i++) {
+    add_name(writable[i]);
+  }
+  add_name("nosuch");
+  add_name("floo");
+
+  const int rounds = 200000;
+  printf("%d names, best of 5, ns per dispatch\n", name_count);
+  printf("registry:     %.1f\n", bench(registry::set, rounds));
+  printf("strcmp chain: %.1f\n", bench(chain_set, rounds));
+
+  // Cost by position in the chain: the first name, the last name and a miss
+  const char * single[] = {"framesize", "floorstop_cells", "nosuch"};
+  for (int i = 0; i < 3; i++) {
+    name_count = 0;
+    add_name(single[i]);
+    double reg = bench(registry::set, rounds * 10);
+    double chain = bench(chain_set, rounds * 10);
+    printf("%-16s registry %.1f, strcmp chain %.1f\n", single[i], reg, chain);
+  }
+  return 0;
+}
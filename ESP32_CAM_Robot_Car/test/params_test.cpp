@@ -0,0 +1,228 @@
+/*
+  ESP32_CAM_Robot_Car
+  test/params_test.cpp
+  Host unit test of the /control parameter registry in params.h
+
+  g++ -std=gnu++11 -Wall -O2 -o params_test params_test.cpp && ./params_test
+*/
+
+#include "../params.h"
+#include "../robot_params.h"
+#include <stdio.h>
+
+// Largest frame size of the current camera driver, the registry only uses it as a bound
+#define FRAMESIZE_UXGA 13
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+static int last_set = -1;
+static const char * last_name = NULL;
+static int value = 7;
+
+static int set_value(int val) {
+  last_set = val;
+  return 0;
+}
+
+static int get_value() {
+  return value;
+}
+
+// Stand-ins for the setters and getters of app_httpd.cpp, so ROBOT_PARAMS expands unchanged
+#define STUB_SETTER(f) static int f(int val) { return set_value(val); }
+#define STUB_GETTER(f) static int f() { return get_value(); }
+STUB_SETTER(set_framesize) STUB_GETTER(get_framesize)
+STUB_SETTER(set_quality) STUB_GETTER(get_quality)
+STUB_SETTER(set_flash) STUB_GETTER(get_flash)
+STUB_SETTER(set_speed) STUB_GETTER(get_speed_param)
+STUB_SETTER(set_nostop) STUB_GETTER(get_nostop)
+STUB_SETTER(set_car)
+STUB_SETTER(set_telemetry) STUB_GETTER(get_telemetry)
+STUB_SETTER(set_odometry) STUB_GETTER(get_odometry)
+STUB_SETTER(set_odom_heading)
+STUB_SETTER(set_odom_forward) STUB_GETTER(get_odom_forward)
+STUB_GETTER(get_odom_time)
+STUB_SETTER(set_floor) STUB_GETTER(get_floor)
+STUB_SETTER(set_floorcal) STUB_GETTER(get_floorcal)
+STUB_SETTER(set_floorstop) STUB_GETTER(get_floorstop)
+STUB_SETTER(set_floorstop_cells) STUB_GETTER(get_floorstop_cells)
+STUB_GETTER(get_floor_front)
+
+static int get_odom_heading() {
+  return -42;
+}
+
+static void log_name(const char * name) {
+  last_name = name;
+}
+
+struct test_params {
+  static constexpr param_t list[] = {
+    ROBOT_PARAMS(PARAM_ENTRY)
+  };
+  static constexpr size_t count = sizeof(list) / sizeof(list[0]);
+};
+constexpr param_t test_params::list[];
+
+typedef param_registry<test_params> registry;
+
+// A registry six times the robot's, to keep the compile-time searches in check as knobs are added
+#define KNOB(n) {"knob_" #n, PARAM_INT, 0, 100, set_value, get_value},
+#define KNOBS10(t) KNOB(t##0) KNOB(t##1) KNOB(t##2) KNOB(t##3) KNOB(t##4) \
+                   KNOB(t##5) KNOB(t##6) KNOB(t##7) KNOB(t##8) KNOB(t##9)
+
+struct large_params {
+  static constexpr param_t list[] = {
+    KNOBS10(0) KNOBS10(1) KNOBS10(2) KNOBS10(3) KNOBS10(4)
+    KNOBS10(5) KNOBS10(6) KNOBS10(7) KNOBS10(8) KNOBS10(9)
+  };
+  static constexpr size_t count = sizeof(list) / sizeof(list[0]);
+};
+constexpr param_t large_params::list[];
+
+typedef param_registry<large_params> large_registry;
+
+template<class R, class P> static void check_table() {
+  CHECK(R::size >= 2 * P::count);
+  CHECK((R::size & R::mask) == 0);
+  // Every slot points at a parameter that hashes to it, and every parameter owns one slot
+  int owned = 0;
+  for (uint32_t slot = 0; slot < R::size; slot++) {
+    int i = R::slot_table::table[slot];
+    if (i >= 0) {
+      CHECK(param_slot(P::list[i].name, R::seed, R::mask) == slot);
+      owned++;
+    }
+  }
+  CHECK(owned == (int)P::count);
+  for (size_t i = 0; i < P::count; i++) {
+    CHECK(R::find(P::list[i].name) == &P::list[i]);
+  }
+}
+
+static void test_table() {
+  check_table<registry, test_params>();
+  check_table<large_registry, large_params>();
+  CHECK(large_params::count == 100);
+  CHECK(large_registry::find("knob_100") == NULL && large_registry::find("knob_") == NULL);
+}
+
+static void test_find() {
+  // Near misses that may share a slot with a real name must still be rejected
+  const char * misses[] = {"", "f", "floo", "floors", "Floor", "car ", "cars", "spee", "speed2",
+                           "odom", "odom_", "flash\n", "qualityx", "framesize_", "telemetr"};
+  for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+    CHECK(registry::find(misses[i]) == NULL);
+  }
+}
+
+static void test_set() {
+  CHECK(registry::set("quality", 10) == 0 && last_set == 10);
+  CHECK(registry::set("quality", 99) == 0 && last_set == 63);
+  CHECK(registry::set("quality", -5) == 0 && last_set == 0);
+  CHECK(registry::set("nostop", 5) == 0 && last_set == 1);
+  CHECK(registry::set("nostop", 0) == 0 && last_set == 0);
+  CHECK(registry::set("car", 3) == 0 && last_set == 3);
+  CHECK(registry::set("framesize", 0) == 0 && last_set == 0);
+  CHECK(registry::set("framesize", FRAMESIZE_UXGA) == 0 && last_set == FRAMESIZE_UXGA);
+  last_set = -1;
+  CHECK(registry::set("framesize", FRAMESIZE_UXGA + 1) == -1 && last_set == -1);
+  CHECK(registry::set("car", 6) == -1 && last_set == -1);
+  CHECK(registry::set("car", 0) == -1 && last_set == -1);
+  CHECK(registry::set("odom_time", 1) == -1 && last_set == -1);
+  CHECK(registry::set("nosuch", 1) == -1 && last_set == -1);
+  CHECK(large_registry::set("knob_57", 150) == 0 && last_set == 100);
+}
+
+static void test_query_value() {
+  char val[8];
+  CHECK(param_query_value("var=speed&val=200", "var", val, sizeof(val)) && !strcmp(val, "speed"));
+  CHECK(param_query_value("var=speed&val=200", "val", val, sizeof(val)) && !strcmp(val, "200"));
+  CHECK(param_query_value("val=&var=x", "val", val, sizeof(val)) && !strcmp(val, ""));
+  // Keys match whole, values that do not fit are refused
+  CHECK(!param_query_value("variable=1&xval=2", "var", val, sizeof(val)));
+  CHECK(!param_query_value("xval=2", "val", val, sizeof(val)));
+  CHECK(!param_query_value("var", "var", val, sizeof(val)));
+  CHECK(!param_query_value("var=framesize", "var", val, sizeof(val)));
+}
+
+static void test_set_query() {
+  char query[128];
+  int applied = -1;
+
+  // var / val form, as sent by the web UI
+  strcpy(query, "var=speed&val=200");
+  CHECK(registry::set_query(query, &applied, log_name) == 0 && applied == 1 && last_set == 200);
+  strcpy(query, "val=1&var=floor");
+  CHECK(registry::set_query(query, &applied, log_name) == 0 && applied == 1 && last_set == 1);
+  last_name = NULL;
+  strcpy(query, "var=nosuch&val=1");
+  CHECK(registry::set_query(query, &applied, log_name) == -1 && applied == 1);
+  CHECK(last_name && !strcmp(last_name, "nosuch"));
+
+  // Batch form, every pair is applied and a failing one does not stop the rest
+  last_name = NULL;
+  strcpy(query, "speed=180&quality=99&nostop=3");
+  CHECK(registry::set_query(query, &applied, log_name) == 0 && applied == 3 && last_set == 1);
+  CHECK(last_name == NULL);
+  strcpy(query, "car=9&quality=12");
+  CHECK(registry::set_query(query, &applied, log_name) == -1 && applied == 2 && last_set == 12);
+  CHECK(last_name && !strcmp(last_name, "car"));
+  strcpy(query, "var=speed&quality=5");
+  CHECK(registry::set_query(query, &applied, NULL) == -1 && applied == 2 && last_set == 5);
+
+  // Nothing that looks like a parameter, cmd_handler answers 404
+  strcpy(query, "speed&&x");
+  CHECK(registry::set_query(query, &applied, log_name) == 0 && applied == 0);
+}
+
+static void test_serialize() {
+  char buf[1024];
+  char * end = registry::serialize(buf);
+  *end = 0;
+  CHECK(buf[0] == '{' && end[-1] == '}');
+  CHECK(strstr(buf, "\"quality\":7") != NULL);
+  CHECK(strstr(buf, "\"odom_heading\":-42") != NULL);
+  CHECK(strstr(buf, "\"odom_time\":7") != NULL);
+  // Write-only parameters are left out
+  CHECK(strstr(buf, "\"flashoff\"") == NULL);
+  CHECK(strstr(buf, "\"car\"") == NULL);
+  CHECK(strstr(buf, ",,") == NULL && strstr(buf, "{,") == NULL);
+}
+
+static void test_append() {
+  char buf[32];
+  *append_int(buf, 0) = 0;
+  CHECK(!strcmp(buf, "0"));
+  *append_int(buf, -2147483647 - 1) = 0;
+  CHECK(!strcmp(buf, "-2147483648"));
+  *append_uint(buf, 4294967295u) = 0;
+  CHECK(!strcmp(buf, "4294967295"));
+}
+
+int main() {
+  test_table();
+  test_find();
+  test_set();
+  test_query_value();
+  test_set_query();
+  test_serialize();
+  test_append();
+  printf("seed %u, %u slots for %u parameters\n",
+         (unsigned)registry::seed, (unsigned)registry::size, (unsigned)test_params::count);
+  printf("seed %u, %u slots for %u parameters\n",
+         (unsigned)large_registry::seed, (unsigned)large_registry::size, (unsigned)large_params::count);
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+  ESP32_CAM_Robot_Car
+  test/trace.h
+  Frames of a session recorded by TraceRecorder in playground.ipynb, for the host harnesses
+
+  A trace directory holds events.jsonl, with one JSON event per line, and the
+  stream frames as frames/NNNNNN.jpg. Frames are decoded with libjpeg at the
+  smallest DCT scale that fits, the same decimation esp_jpg_decode does on the robot.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <jpeglib.h>
+
+typedef struct {
+  int n;       // frame number, frames/<n>.jpg
+  double t;    // seconds since the recording started
+} trace_frame_t;
+
+// Reads the frame events of dir/events.jsonl into a malloc'd array, returns their count or -1
+static inline int trace_frames(const char * dir, trace_frame_t ** frames) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/events.jsonl", dir);
+  FILE * f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+  int count = 0;
+  int size = 256;
+  trace_frame_t * out = (trace_frame_t *)malloc(size * sizeof(trace_frame_t));
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    const char * kind = strstr(line, "\"kind\": \"frame\"");
+    const char * t = strstr(line, "\"t\": ");
+    const char * n = strstr(line, "\"n\": ");
+    if (!kind || !t || !n) {
+      continue;
+    }
+    if (count == size) {
+      size *= 2;
+      out = (trace_frame_t *)realloc(out, size * sizeof(trace_frame_t));
+    }
+    out[count].t = atof(t + 5);
+    out[count].n = atoi(n + 5);
+    count++;
+  }
+  fclose(f);
+  *frames = out;
+  return count;
+}
+
+// Decodes frame n of dir to a malloc'd RGB888 image, scaled down by 1/2, 1/4 or 1/8 until it
+// fits in max_w x max_h (0 for full size). Returns NULL if the frame cannot be read.
+static inline uint8_t * trace_decode(const char * dir, int n, int max_w, int max_h, int * width, int * height) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/frames/%06d.jpg", dir, n);
+  FILE * f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, f);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 1;
+  if (max_w && max_h) {
+    while (cinfo.scale_denom < 8 &&
+           ((int)cinfo.image_width / (int)cinfo.scale_denom > max_w ||
+            (int)cinfo.image_height / (int)cinfo.scale_denom > max_h)) {
+      cinfo.scale_denom *= 2;
+    }
+  }
+  jpeg_start_decompress(&cinfo);
+  int w = cinfo.output_width;
+  int h = cinfo.output_height;
+  uint8_t * rgb = (uint8_t *)malloc(w * h * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = rgb + cinfo.output_scanline * w * 3;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(f);
+  *width = w;
+  *height = h;
+  return rgb;
+}
+
+// Same conversion as vision_feed in app_httpd.cpp
+static inline void trace_gray(const uint8_t * rgb, uint8_t * gray, int pixels) {
+  for (int i = 0; i < pixels; i++) {
+    const uint8_t * px = rgb + i * 3;
+    gray[i] = (px[0] + 2 * px[1] + px[2]) >> 2;
+  }
+}
+
+static inline double trace_now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#endif
@@ -0,0 +1,211 @@
+/*
+  ESP32_CAM_Robot_Car
+  planner/jps.cpp
+  Jump point search for plan_path in playground.ipynb, loaded there with ctypes
+
+  The same search as jps() in the notebook, node for node: octile costs, no corner
+  cutting, and open list ties broken on the lower cell index, so both return the
+  same path. The grid is the padded buffer jps() builds and NavMap.padded keeps,
+  uint8 with 1 walkable and 0 blocked and a blocked border, read in place so the
+  scans need no bounds checks. Cells are flat indices into it. Only jump points
+  enter the open list, so their state is kept in a hash map instead of arrays the
+  size of the map, and a search costs nothing for the cells it never reaches.
+
+  g++ -std=c++11 -O2 -Wall -shared -fPIC -o libjps.so jps.cpp
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef struct {
+  double g;
+  int parent;    // -1 for the start
+  bool closed;
+} node_t;
+
+typedef std::pair<double, int> open_t;  // f, cell
+
+static inline int sign(int v) {
+  return (v > 0) - (v < 0);
+}
+
+// Octile distance, with the same operations as octile() so costs match to the last bit
+static inline double octile(int r0, int c0, int r1, int c1) {
+  int dr = abs(r0 - r1);
+  int dc = abs(c0 - c1);
+  return (double)(dr > dc ? dr : dc) + (sqrt(2.0) - 1) * (double)(dr < dc ? dr : dc);
+}
+
+// Walk from i along step until a forced neighbor, the goal or a wall
+static int jump_straight(const uint8_t * w, int i, int step, int perp, int goal) {
+  while (w[i]) {
+    if (i == goal) {
+      return i;
+    }
+    if ((w[i + perp] && !w[i - step + perp]) || (w[i - perp] && !w[i - step - perp])) {
+      return i;
+    }
+    i += step;
+  }
+  return -1;
+}
+
+// Next jump point from i in direction (dr, dc), -1 if there is none
+static int jump(const uint8_t * w, int i, int dr, int dc, int width, int goal) {
+  if (dr && dc) {
+    int sr = dr * width;
+    while (w[i]) {
+      if (i == goal) {
+        return i;
+      }
+      if (jump_straight(w, i + sr, sr, 1, goal) >= 0 || jump_straight(w, i + dc, dc, width, goal) >= 0) {
+        return i;
+      }
+      if (!(w[i + sr] && w[i + dc])) {
+        return -1;
+      }
+      i += sr + dc;
+    }
+    return -1;
+  }
+  if (dr) {
+    return jump_straight(w, i, dr * width, 1, goal);
+  }
+  return jump_straight(w, i, dc, width, goal);
+}
+
+// Pruned directions for a cell reached moving in direction (dr, dc), in the order of _successor_dirs
+static int successor_dirs(const uint8_t * w, int i, int dr, int dc, int width, int dirs[8][2]) {
+  int n = 0;
+#define DIR(r, c) do { dirs[n][0] = (r); dirs[n][1] = (c); n++; } while (0)
+  if (dr && dc) {
+    bool v = w[i + dr * width];
+    bool h = w[i + dc];
+    if (v) DIR(dr, 0);
+    if (h) DIR(0, dc);
+    if (v && h) DIR(dr, dc);
+  } else if (dr) {
+    bool next = w[i + dr * width];
+    bool left = w[i - 1];
+    bool right = w[i + 1];
+    if (next) {
+      DIR(dr, 0);
+      if (left) DIR(dr, -1);
+      if (right) DIR(dr, 1);
+    }
+    if (left) DIR(0, -1);
+    if (right) DIR(0, 1);
+  } else {
+    bool next = w[i + dc];
+    bool up = w[i - width];
+    bool down = w[i + width];
+    if (next) {
+      DIR(0, dc);
+      if (up) DIR(-1, dc);
+      if (down) DIR(1, dc);
+    }
+    if (up) DIR(-1, 0);
+    if (down) DIR(1, 0);
+  }
+#undef DIR
+  return n;
+}
+
+// Every direction out of the start that is walkable without cutting a corner
+static int start_dirs(const uint8_t * w, int i, int width, int dirs[8][2]) {
+  int n = 0;
+  for (int dr = -1; dr <= 1; dr++) {
+    for (int dc = -1; dc <= 1; dc++) {
+      if ((dr || dc) && w[i + dr * width + dc] &&
+          (!(dr && dc) || (w[i + dr * width] && w[i + dc]))) {
+        dirs[n][0] = dr;
+        dirs[n][1] = dc;
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+/*
+  Search the padded grid w of height x width from cell start to cell goal.
+  Writes the jump points from start to goal into path, at most max_path of them,
+  and returns how many there are: 0 when there is no path, more than max_path when
+  path was too short, in which case the caller searches again with a larger one.
+*/
+extern "C" int jps_plan(const uint8_t * w, int height, int width, int start, int goal,
+                        int32_t * path, int max_path) {
+  int cells = height * width;
+  if (start < 0 || start >= cells || goal < 0 || goal >= cells || !w[start] || !w[goal]) {
+    return 0;
+  }
+  int gr = goal / width;
+  int gc = goal % width;
+
+  std::unordered_map<int, node_t> nodes;
+  nodes.reserve(1024);
+  std::priority_queue<open_t, std::vector<open_t>, std::greater<open_t> > open;
+  node_t first = {0.0, -1, false};
+  nodes[start] = first;
+  open.push(open_t(octile(start / width, start % width, gr, gc), start));
+
+  int dirs[8][2];
+  while (!open.empty()) {
+    int current = open.top().second;
+    open.pop();
+    if (current == goal) {
+      int n = 0;
+      for (int i = current; i >= 0; i = nodes[i].parent) {
+        n++;
+      }
+      if (n <= max_path) {
+        int k = n;
+        for (int i = current; i >= 0; i = nodes[i].parent) {
+          path[--k] = i;
+        }
+      }
+      return n;
+    }
+    node_t & node = nodes[current];
+    if (node.closed) {
+      continue;
+    }
+    node.closed = true;
+    double g = node.g;
+
+    int cr = current / width;
+    int cc = current % width;
+    int count;
+    if (node.parent >= 0) {
+      int pr = node.parent / width;
+      int pc = node.parent % width;
+      count = successor_dirs(w, current, sign(cr - pr), sign(cc - pc), width, dirs);
+    } else {
+      count = start_dirs(w, current, width, dirs);
+    }
+
+    for (int d = 0; d < count; d++) {
+      int jp = jump(w, current + dirs[d][0] * width + dirs[d][1], dirs[d][0], dirs[d][1], width, goal);
+      if (jp < 0) {
+        continue;
+      }
+      int jr = jp / width;
+      int jc = jp % width;
+      double tentative = g + octile(cr, cc, jr, jc);
+      std::unordered_map<int, node_t>::iterator it = nodes.find(jp);
+      if (it != nodes.end() && (it->second.closed || tentative >= it->second.g)) {
+        continue;
+      }
+      node_t next = {tentative, current, false};
+      nodes[jp] = next;
+      open.push(open_t(tentative + octile(jr, jc, gr, gc), jp));
+    }
+  }
+  return 0;
+}